@@ -0,0 +1,86 @@
+#include "Arena.h"
+
+// Size of the buffer each thread keeps for its requests, a listing of a few thousand meals fits
+static const size_t arena_buffer_size = 256 * 1024;
+
+std::atomic<uint64_t> RequestArena::threads_{ 0 };
+std::atomic<uint64_t> RequestArena::requests_{ 0 };
+std::atomic<uint64_t> RequestArena::allocations_{ 0 };
+std::atomic<uint64_t> RequestArena::bytes_allocated_{ 0 };
+std::atomic<uint64_t> RequestArena::peak_request_bytes_{ 0 };
+std::atomic<uint64_t> RequestArena::upstream_allocations_{ 0 };
+
+RequestArena::RequestArena()
+	: buffer_(arena_buffer_size)
+	, heap_(std::pmr::new_delete_resource())
+	, monotonic_(buffer_.data(), buffer_.size(), &heap_)
+	, front_(&monotonic_)
+{
+	threads_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Gets the arena of the calling thread, created on first use
+/// </summary>
+/// <returns>the arena</returns>
+RequestArena& RequestArena::get()
+{
+	thread_local RequestArena arena;
+	return arena;
+}
+
+/// <summary>
+/// Releases everything allocated since the last reset and publishes the statistics of the request.
+/// the shared counters are only touched here, once per request
+/// </summary>
+void RequestArena::reset()
+{
+	uint64_t bytes = front_.bytes();
+	uint64_t allocations = front_.allocations();
+	uint64_t upstream = heap_.allocations();
+
+	monotonic_.release();
+	front_.clear();
+	heap_.clear();
+
+	requests_.fetch_add(1, std::memory_order_relaxed);
+	allocations_.fetch_add(allocations, std::memory_order_relaxed);
+	bytes_allocated_.fetch_add(bytes, std::memory_order_relaxed);
+	if (upstream != 0)
+	{
+		upstream_allocations_.fetch_add(upstream, std::memory_order_relaxed);
+	}
+	uint64_t peak = peak_request_bytes_.load(std::memory_order_relaxed);
+	while (bytes > peak && !peak_request_bytes_.compare_exchange_weak(peak, bytes, std::memory_order_relaxed))
+	{
+	}
+}
+
+/// <summary>
+/// Gets the statistics of all the arenas
+/// </summary>
+/// <returns>the statistics</returns>
+RequestArena::Statistics RequestArena::get_statistics()
+{
+	Statistics statistics;
+	statistics.threads = threads_.load(std::memory_order_relaxed);
+	statistics.requests = requests_.load(std::memory_order_relaxed);
+	statistics.allocations = allocations_.load(std::memory_order_relaxed);
+	statistics.bytes_allocated = bytes_allocated_.load(std::memory_order_relaxed);
+	statistics.peak_request_bytes = peak_request_bytes_.load(std::memory_order_relaxed);
+	statistics.upstream_allocations = upstream_allocations_.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+void* RequestArena::CountingResource::do_allocate(size_t bytes, size_t alignment)
+{
+	void* p = upstream_->allocate(bytes, alignment);
+	bytes_ += bytes;
+	allocations_++;
+	return p;
+}
+
+void RequestArena::CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+	upstream_->deallocate(p, bytes, alignment);
+}
\ No newline at end of file
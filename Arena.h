@@ -0,0 +1,93 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+/// <summary>
+/// RequestArena is a per thread bump allocator for the scratch memory of a request
+/// (rows read from the database, serialized responses). Allocations only move a pointer forward,
+/// deallocations are ignored and everything is released at once by reset() when the
+/// response has been built. The arena starts from a preallocated buffer, the global
+/// heap is only used by requests that outgrow it.
+/// </summary>
+class RequestArena
+{
+public:
+	struct Statistics
+	{
+		uint64_t threads;				// number of threads that own an arena
+		uint64_t requests;				// number of resets, one per request
+		uint64_t allocations;			// allocations served by all the arenas instead of the global heap
+		uint64_t bytes_allocated;		// bytes handed out by all the arenas
+		uint64_t peak_request_bytes;	// largest amount of scratch memory used by one request
+		uint64_t upstream_allocations;	// blocks taken from the global heap once the buffer is full
+	};
+
+	// Get the arena of the calling thread
+	static RequestArena& get();
+	// Get the statistics of all the arenas
+	static Statistics get_statistics();
+
+	std::pmr::memory_resource* resource() { return &front_; }
+	void reset();
+
+private:
+	RequestArena();
+	RequestArena(const RequestArena&) = delete;
+	RequestArena& operator=(const RequestArena&) = delete;
+
+	// Forward the allocations to another resource and count them
+	class CountingResource : public std::pmr::memory_resource
+	{
+	public:
+		explicit CountingResource(std::pmr::memory_resource* upstream) : upstream_(upstream) {}
+		size_t bytes() const { return bytes_; }
+		size_t allocations() const { return allocations_; }
+		void clear() { bytes_ = 0; allocations_ = 0; }
+
+	private:
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+		std::pmr::memory_resource* upstream_;
+		size_t bytes_ = 0;
+		size_t allocations_ = 0;
+	};
+
+	std::vector<std::byte>					buffer_;	// initial block, reused by every request
+	CountingResource						heap_;		// blocks taken from the global heap
+	std::pmr::monotonic_buffer_resource		monotonic_;	// bump allocator over buffer_ then heap_
+	CountingResource						front_;		// what the request allocates
+
+	static std::atomic<uint64_t>			threads_;
+	static std::atomic<uint64_t>			requests_;
+	static std::atomic<uint64_t>			allocations_;
+	static std::atomic<uint64_t>			bytes_allocated_;
+	static std::atomic<uint64_t>			peak_request_bytes_;
+	static std::atomic<uint64_t>			upstream_allocations_;
+};
+
+/// <summary>
+/// ArenaScope resets the arena of the calling thread when the handler returns
+/// </summary>
+class ArenaScope
+{
+public:
+	ArenaScope() : arena_(RequestArena::get()) {}
+	~ArenaScope() { arena_.reset(); }
+
+	std::pmr::memory_resource* resource() { return arena_.resource(); }
+
+private:
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+	RequestArena& arena_;
+};
+
+#endif
\ No newline at end of file
@@ -1,25 +1,103 @@
+#ifndef DBMEAL_H
+#define DBMEAL_H
+
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
 
 
 /// <summary>
 /// DBMeal class to store the meal information
+/// the price is stored in minor units (cents), a legacy meal whose price could not
+/// be converted has no price
 /// </summary>
 class DBMeal
 {
 private:
+	int64_t id;
 	std::string name;
 	int quantity;
-	std::string price;
+	int64_t price_cents;
+	bool priced;
 
 public:
-	DBMeal() : name(""), quantity(0), price("") {}
-	DBMeal(std::string name, int quantity, std::string price) : name(name), quantity(quantity), price(price) {}
+	DBMeal() : id(0), name(""), quantity(0), price_cents(0), priced(true) {}
+	DBMeal(std::string name, int quantity, int64_t price_cents) : id(0), name(std::move(name)), quantity(quantity), price_cents(price_cents), priced(true) {}
 
-	std::string get_name() const { return name; }
+	int64_t get_id() const { return id; }
+	const std::string& get_name() const { return name; }
 	int get_quantity() const { return quantity; }
-	std::string get_price() const { return price; }
+	int64_t get_price_cents() const { return price_cents; }
+	bool has_price() const { return priced; }
 
-	void set_name(std::string name) { this->name = name; }
+	void set_id(int64_t id) { this->id = id; }
+	void set_name(std::string name) { this->name = std::move(name); }
 	void set_quantity(int quantity) { this->quantity = quantity; }
-	void set_price(std::string price) { this->price = price; }
-};
\ No newline at end of file
+	void set_price_cents(int64_t price_cents) { this->price_cents = price_cents; this->priced = true; }
+	void clear_price() { this->price_cents = 0; this->priced = false; }
+};
+
+/// <summary>
+/// DBMealSet class to store the result of a query returning several meals
+/// the rows are small fixed structs stored in one vector, the names are packed
+/// in a single string and each row keeps the offset and length of its name.
+/// A set is filled by DBSQLite and moved to the caller, never copied row by row.
+/// Both buffers come from the memory resource given to the constructor, a request
+/// arena keeps the rows of a listing off the global heap.
+/// </summary>
+class DBMealSet
+{
+public:
+	struct Row
+	{
+		int64_t id;
+		int64_t price_cents;
+		uint32_t name_offset;
+		uint32_t name_length;
+		int quantity;
+		bool has_price;		// false for a NULL price, price_cents is then 0
+	};
+
+	explicit DBMealSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : rows(resource), names(resource) {}
+	DBMealSet(DBMealSet&&) = default;
+	DBMealSet& operator=(DBMealSet&&) = default;
+	DBMealSet(const DBMealSet&) = delete;
+	DBMealSet& operator=(const DBMealSet&) = delete;
+
+	void reserve(size_t row_count, size_t name_bytes)
+	{
+		rows.reserve(row_count);
+		names.reserve(name_bytes);
+	}
+
+	void add(int64_t id, const char* name, size_t name_length, int quantity, int64_t price_cents, bool has_price = true)
+	{
+		rows.push_back(Row{ id, price_cents, static_cast<uint32_t>(names.size()), static_cast<uint32_t>(name_length), quantity, has_price });
+		names.append(name, name_length);
+	}
+
+	// Copy a row of another set at the end of this one
+	void append(const DBMealSet& other, size_t index)
+	{
+		const Row& row = other.rows[index];
+		add(row.id, other.names.data() + row.name_offset, row.name_length, row.quantity, row.price_cents, row.has_price);
+	}
+
+	std::string_view get_name(const Row& row) const { return std::string_view(names.data() + row.name_offset, row.name_length); }
+	size_t get_name_bytes() const { return names.size(); }
+
+	size_t size() const { return rows.size(); }
+	bool empty() const { return rows.empty(); }
+	const Row& operator[](size_t index) const { return rows[index]; }
+	std::pmr::vector<Row>::const_iterator begin() const { return rows.begin(); }
+	std::pmr::vector<Row>::const_iterator end() const { return rows.end(); }
+	std::pmr::memory_resource* get_resource() const { return rows.get_allocator().resource(); }
+
+private:
+	std::pmr::vector<Row> rows;
+	std::pmr::string names;
+};
+
+#endif
\ No newline at end of file
@@ -2,31 +2,114 @@
 #define DATABASE_H
 
 #include <SQLiteCpp/SQLiteCpp.h>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <crow.h>
-#include <list>
 #include "DBMeal.h"
+#include "MealStats.h"
+
+/// BackupPacing controls how fast an online backup copies the database.
+/// The source is locked while a step copies its pages: the number of pages
+/// per step is halved when a step takes longer than max_step and doubled
+/// again when it is well under, up to max_pages_per_step.
+struct BackupPacing
+{
+    int                         pages_per_step = 64;
+    int                         max_pages_per_step = 1024;
+    std::chrono::microseconds   max_step{ 2000 };
+    std::chrono::milliseconds   pause{ 5 };         // pause between two steps
+
+    // measured by the last backup
+    int                         steps = 0;
+    std::chrono::microseconds   longest_step{ 0 };
+};
 
 /// DBSQLite definition
+/// the meals can be spread over several database files (shards), each with its own
+/// writer: a meal goes to the shard given by the hash of its name and its id encodes
+/// the shard (id = local id * shard count + shard). With one shard the file and the
+/// ids are the ones of an unsharded database.
 class DBSQLite
 {
 // Constructor
 public:
-	DBSQLite(const std::string& file_name);
+	DBSQLite(const std::string& file_name, size_t shard_count = 1);
 	virtual ~DBSQLite() {};
 
 // public methods
 public:
-    void                create_new_meal(const DBMeal& meal);
-    std::list<DBMeal>   get_all_meals();
-    DBMeal              get_meal_by_id(int id);
+    int64_t             create_new_meal(const DBMeal& meal);
+    DBMealSet           get_all_meals(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    DBMealSet           get_meals_by_price(int64_t min_price_cents, int64_t max_price_cents, bool sort_by_price,
+                                           std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    DBMeal              get_meal_by_id(int64_t id);
     DBMeal              get_meal_by_name(const std::string& name);
-    int                 delete_mail_by_id(int id);
+    int                 delete_mail_by_id(int64_t id);
     void                drop_table_meals();
     void                create_table_if_not_exist();
+    void                backup_to(const std::string& folder, BackupPacing& pacing);
+    size_t              get_shard_count() const { return shards_.size(); }
+    size_t              shard_for_name(const std::string& name) const;
+    size_t              shard_index_for_id(int64_t id) const;
+    MealStats::Totals   get_stats();
+    bool                verify_stats();
 
 private:
-    SQLite::Database    db_;    // Database connection   
+    // One database file with its write connection and its pool of read only connections
+    struct Shard
+    {
+        Shard(const std::string& file_name);
+
+        std::string         file_name;
+        SQLite::Database    db;             // Database connection used by the writes
+        std::mutex          write_mutex;    // one write at a time on db
+
+        std::mutex                                      readers_mutex;
+        std::vector<std::unique_ptr<SQLite::Database>>  readers;    // idle read only connections
+
+        MealStats           stats;          // aggregates of the meals, updated by the writes
+        std::atomic<uint64_t> writes{ 0 };  // number of writes, tells verify_stats that its scan may be stale
+
+        // slow statements are explained on a connection of their own, never on the one running them
+        std::mutex                                                              explain_mutex;
+        std::unique_ptr<SQLite::Database>                                       explain;
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point>  explained;  // when a plan was last logged
+    };
+
+    // Read only connection borrowed from the pool of a shard for the duration of a query
+    class ReadConnection
+    {
+    public:
+        ReadConnection(Shard& shard);
+        ~ReadConnection();
+        SQLite::Database& get() { return *connection_; }
+
+    private:
+        Shard&                              shard_;
+        std::unique_ptr<SQLite::Database>   connection_;
+    };
+
+    // Order of the rows when the results of the shards are merged
+    enum class MealOrder { None, Id, Price };
+
+    int64_t             global_id(size_t shard, int64_t local_id) const;
+    Shard*              shard_for_id(int64_t id, int64_t& local_id);
+    void                upgrade_schema(Shard& shard);
+    void                load_stats(SQLite::Database& connection, MealStats& stats);
+    DBMealSet           read_meals(SQLite::Statement& query, int64_t row_count, size_t shard, std::pmr::memory_resource* resource);
+    DBMealSet           merge_meals(std::vector<DBMealSet>& sets, MealOrder order);
+
+    static void         trace_statements(Shard& shard, SQLite::Database& connection);
+    static int          on_statement_profile(unsigned type, void* context, void* statement, void* elapsed);
+    static void         explain_statement(Shard& shard, const std::string& sql, std::chrono::nanoseconds elapsed);
+
+    std::vector<std::unique_ptr<Shard>>     shards_;
 };
 
-#endif 
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -1,15 +1,297 @@
+#include <algorithm>
 #include <filesystem>
+#include <queue>
+#include <thread>
 #include <SQLiteCpp/SQLiteCpp.h>
+#include <sqlite3.h>
 #include "DataBase.h"
+#include "utility.h"
 
 namespace fs = std::filesystem;
 
 static const std::string data_db = "meals.txt";
 
+// Bytes reserved per name when a DBMealSet is allocated, longer names make the buffer grow
+static const size_t average_name_bytes = 32;
 
-DBSQLite::DBSQLite(const std::string& file_name) : db_(file_name.c_str(), SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE)
+// Statements slower than this get their query plan logged, at most once per interval for the same statement
+static const std::chrono::milliseconds slow_statement_threshold(50);
+static const std::chrono::seconds slow_statement_log_interval(60);
+
+// Scans of a shard by verify_stats before giving up until the next check, a scan is
+// done again when a write happened during it
+static const int stats_check_attempts = 3;
+
+/// <summary>
+/// Get the file of a shard: database.db3 becomes database.shard0.db3, database.shard1.db3...
+/// a single shard keeps the file name
+/// </summary>
+static std::string shard_file_name(const std::string& file_name, size_t shard, size_t shard_count)
+{
+	if (shard_count == 1)
+	{
+		return file_name;
+	}
+	fs::path path(file_name);
+	fs::path name = path.stem();
+	name += ".shard" + std::to_string(shard);
+	name += path.extension();
+	return (path.parent_path() / name).string();
+}
+
+/// <summary>
+/// Read the position of a shard and the number of shards saved in a database file
+/// </summary>
+/// <returns>false if the file has no shard_info, a file of an older version</returns>
+static bool read_shard_info(const std::string& file_name, int64_t& shard, int64_t& shard_count)
 {
+	SQLite::Database db(file_name, SQLite::OPEN_READONLY);
+	SQLite::Statement table(db, "SELECT name FROM sqlite_master WHERE type='table' AND name='shard_info'");
+	if (!table.executeStep())
+	{
+		return false;
+	}
+	SQLite::Statement query(db, "SELECT shard, shard_count FROM shard_info");
+	if (!query.executeStep())
+	{
+		return false;
+	}
+	shard = query.getColumn(0).getInt64();
+	shard_count = query.getColumn(1).getInt64();
+	return true;
+}
+
+/// <summary>
+/// Check that the database files match the number of shards before any of them is opened for writing.
+/// the ids and the placement of the meals depend on the number of shards, a database is never
+/// opened with another number: the server refuses to start instead of serving part of the meals
+/// </summary>
+static void check_shard_layout(const std::string& file_name, size_t shard_count)
+{
+	size_t existing = 0;
+	for (size_t i = 0; i < shard_count; i++)
+	{
+		std::string shard_name = shard_file_name(file_name, i, shard_count);
+		if (!fs::exists(shard_name))
+		{
+			continue;
+		}
+		existing++;
+		int64_t saved_shard = 0;
+		int64_t saved_count = 0;
+		if (read_shard_info(shard_name, saved_shard, saved_count) &&
+			(saved_count != static_cast<int64_t>(shard_count) || saved_shard != static_cast<int64_t>(i)))
+		{
+			throw std::runtime_error(shard_name + " is shard " + std::to_string(saved_shard) + " of " + std::to_string(saved_count) +
+				", the database is opened with " + std::to_string(shard_count) + " shards: set RESTAPI_SHARDS to " + std::to_string(saved_count));
+		}
+	}
+
+	// files left by another number of shards, those of an older version have no shard_info
+	if (shard_count == 1)
+	{
+		if (fs::exists(shard_file_name(file_name, 0, 2)))
+		{
+			throw std::runtime_error("a sharded database exists next to " + file_name + ": set RESTAPI_SHARDS to its number of shards");
+		}
+	}
+	else
+	{
+		if (fs::exists(file_name))
+		{
+			SQLite::Database db(file_name, SQLite::OPEN_READONLY);
+			SQLite::Statement table(db, "SELECT name FROM sqlite_master WHERE type='table' AND name='meals'");
+			if (table.executeStep())
+			{
+				throw std::runtime_error("the unsharded database " + file_name + " cannot be opened with " + std::to_string(shard_count) +
+					" shards: unset RESTAPI_SHARDS or move the file away to start a new database");
+			}
+		}
+		if (fs::exists(shard_file_name(file_name, shard_count, shard_count + 1)))
+		{
+			throw std::runtime_error("the database has more than " + std::to_string(shard_count) + " shards: set RESTAPI_SHARDS to its number of shards");
+		}
+	}
+
+	if (existing != 0 && existing != shard_count)
+	{
+		throw std::runtime_error(std::to_string(shard_count - existing) + " of the " + std::to_string(shard_count) + " shards of " + file_name + " are missing");
+	}
+}
+
+
+DBSQLite::DBSQLite(const std::string& file_name, size_t shard_count)
+{
+	shard_count = std::max<size_t>(1, shard_count);
+	check_shard_layout(file_name, shard_count);
+	for (size_t i = 0; i < shard_count; i++)
+	{
+		shards_.push_back(std::make_unique<Shard>(shard_file_name(file_name, i, shard_count)));
+	}
 	create_table_if_not_exist();
+	for (size_t i = 0; i < shards_.size(); i++)
+	{
+		// every file records its place so that it is never opened with another number of shards
+		shards_[i]->db.exec("CREATE TABLE IF NOT EXISTS shard_info (shard INTEGER NOT NULL, shard_count INTEGER NOT NULL)");
+		SQLite::Statement saved(shards_[i]->db, "SELECT COUNT(*) FROM shard_info");
+		saved.executeStep();
+		if (saved.getColumn(0).getInt64() == 0)
+		{
+			saved.reset();
+			SQLite::Statement insert(shards_[i]->db, "INSERT INTO shard_info (shard, shard_count) VALUES (?, ?)");
+			insert.bind(1, static_cast<int64_t>(i));
+			insert.bind(2, static_cast<int64_t>(shards_.size()));
+			insert.exec();
+		}
+		upgrade_schema(*shards_[i]);
+		load_stats(shards_[i]->db, shards_[i]->stats);
+	}
+}
+
+DBSQLite::Shard::Shard(const std::string& file_name) : file_name(file_name), db(file_name.c_str(), SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE)
+{
+	// with the write-ahead log the read connections are not blocked by the writer
+	db.exec("PRAGMA journal_mode=WAL");
+	trace_statements(*this, db);
+}
+
+/// <summary>
+/// Borrow a read only connection from the pool of a shard, a new one is opened if none is idle
+/// </summary>
+DBSQLite::ReadConnection::ReadConnection(Shard& shard) : shard_(shard)
+{
+	{
+		std::lock_guard<std::mutex> lock(shard_.readers_mutex);
+		if (!shard_.readers.empty())
+		{
+			connection_ = std::move(shard_.readers.back());
+			shard_.readers.pop_back();
+		}
+	}
+	if (!connection_)
+	{
+		connection_ = std::make_unique<SQLite::Database>(shard_.file_name, SQLite::OPEN_READONLY);
+		trace_statements(shard_, *connection_);
+	}
+}
+
+/// <summary>
+/// Give the connection back to the pool
+/// </summary>
+DBSQLite::ReadConnection::~ReadConnection()
+{
+	std::lock_guard<std::mutex> lock(shard_.readers_mutex);
+	shard_.readers.push_back(std::move(connection_));
+}
+
+/// <summary>
+/// Time the statements of a connection of a shard.
+/// SQLite measures each statement when its profile callback is set, the callback only
+/// compares the time with the threshold
+/// </summary>
+void DBSQLite::trace_statements(Shard& shard, SQLite::Database& connection)
+{
+	sqlite3_trace_v2(connection.getHandle(), SQLITE_TRACE_PROFILE, &DBSQLite::on_statement_profile, &shard);
+}
+
+/// <summary>
+/// Called by SQLite when a statement is done
+/// </summary>
+/// <param name="context">the shard of the connection</param>
+/// <param name="statement">the sqlite3_stmt</param>
+/// <param name="elapsed">the duration of the statement in nanoseconds</param>
+int DBSQLite::on_statement_profile(unsigned type, void* context, void* statement, void* elapsed)
+{
+	std::chrono::nanoseconds duration(*static_cast<sqlite3_int64*>(elapsed));
+	if (type == SQLITE_TRACE_PROFILE && duration >= slow_statement_threshold)
+	{
+		// no exception must go back through SQLite
+		try
+		{
+			const char* sql = sqlite3_sql(static_cast<sqlite3_stmt*>(statement));
+			if (sql)
+			{
+				explain_statement(*static_cast<Shard*>(context), sql, duration);
+			}
+		}
+		catch (const std::exception& error)
+		{
+			CROW_LOG_WARNING << "Query plan of a slow statement failed: " << error.what();
+		}
+	}
+	return 0;
+}
+
+/// <summary>
+/// Log a slow statement with its query plan.
+/// the parameters are not bound, the plan does not depend on their values and they stay out of the log
+/// </summary>
+/// <param name="shard">the shard the statement ran on</param>
+/// <param name="sql">the text of the statement</param>
+/// <param name="elapsed">the duration of the statement</param>
+void DBSQLite::explain_statement(Shard& shard, const std::string& sql, std::chrono::nanoseconds elapsed)
+{
+	std::lock_guard<std::mutex> lock(shard.explain_mutex);
+	auto now = std::chrono::steady_clock::now();
+	auto logged = shard.explained.find(sql);
+	if (logged != shard.explained.end() && now - logged->second < slow_statement_log_interval)
+	{
+		return;
+	}
+	shard.explained[sql] = now;
+
+	if (!shard.explain)
+	{
+		shard.explain = std::make_unique<SQLite::Database>(shard.file_name, SQLite::OPEN_READONLY);
+	}
+	std::string plan;
+	SQLite::Statement query(*shard.explain, "EXPLAIN QUERY PLAN " + sql);
+	while (query.executeStep())
+	{
+		plan += "\n  ";
+		plan += query.getColumn(3).getString();
+	}
+	CROW_LOG_WARNING << "Slow statement on " << shard.file_name << " ("
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms): " << sql << plan;
+}
+
+/// <summary>
+/// Get the shard holding a meal from the FNV-1a hash of its name.
+/// the hash does not depend on the compiler or the platform, the meals stay in their shard
+/// </summary>
+size_t DBSQLite::shard_for_name(const std::string& name) const
+{
+	return static_cast<size_t>(Utility::fnv1a(name) % shards_.size());
+}
+
+/// <summary>
+/// Get the shard holding a meal from the id seen by the clients, shard 0 for an id that cannot exist
+/// </summary>
+size_t DBSQLite::shard_index_for_id(int64_t id) const
+{
+	return id < 0 ? 0 : static_cast<size_t>(id % static_cast<int64_t>(shards_.size()));
+}
+
+/// <summary>
+/// Get the id seen by the clients from the id of a row in its shard
+/// </summary>
+int64_t DBSQLite::global_id(size_t shard, int64_t local_id) const
+{
+	return local_id * static_cast<int64_t>(shards_.size()) + static_cast<int64_t>(shard);
+}
+
+/// <summary>
+/// Get the shard of a meal and its id in the shard from the id seen by the clients
+/// </summary>
+/// <returns>nullptr if the id cannot exist</returns>
+DBSQLite::Shard* DBSQLite::shard_for_id(int64_t id, int64_t& local_id)
+{
+	if (id < 0)
+	{
+		return nullptr;
+	}
+	local_id = id / static_cast<int64_t>(shards_.size());
+	return shards_[static_cast<size_t>(id % static_cast<int64_t>(shards_.size()))].get();
 }
 /// <summary>
 /// Get a meal by name
@@ -20,18 +302,25 @@ DBMeal DBSQLite::get_meal_by_name(const std::string& name)
 {
 	try
 	{
+		size_t shard = shard_for_name(name);
+		ReadConnection connection(*shards_[shard]);
 		// Create new SQLite::Statement query to get the meal by name
 		// Get the meal by name
 		// throw an exception if the meal is not found
 		// return the meal using a DBMeal class
-		SQLite::Statement query(db_, "SELECT * FROM meals WHERE name = ?");
+		SQLite::Statement query(connection.get(), "SELECT * FROM meals WHERE name = ?");
 		query.bind(1, name);
 		if (query.executeStep())
 		{
 			std::string name = query.getColumn(1).getText();
 			int quantity = query.getColumn(2).getInt();
-			std::string price = query.getColumn(3).getText();
-			DBMeal meal(name, quantity, price);
+			int64_t price_cents = query.getColumn(3).getInt64();
+			DBMeal meal(name, quantity, price_cents);
+			meal.set_id(global_id(shard, query.getColumn(0).getInt64()));
+			if (query.getColumn(3).isNull())
+			{
+				meal.clear_price();
+			}
 			return meal;
 		}
 		else
@@ -46,27 +335,60 @@ DBMeal DBSQLite::get_meal_by_name(const std::string& name)
 }
 /// <summary>
 /// Get all meals from the table "meals".    
+/// the shards are read in id order and merged
 /// </summary>
-/// <returns>Return a list of meals.</returns>
-std::list<DBMeal> DBSQLite::get_all_meals()
+/// <param name="resource">memory of the set</param>
+/// <returns>Return the set of meals.</returns>
+DBMealSet DBSQLite::get_all_meals(std::pmr::memory_resource* resource)
 {
 	try
 	{
-		// Get all meals from the table meals
-		// use a list of DBMeal to store the meals
-		// return the list of meals
+		std::vector<DBMealSet> sets;
+		sets.reserve(shards_.size());
+		for (size_t i = 0; i < shards_.size(); i++)
+		{
+			ReadConnection connection(*shards_[i]);
 
-		std::list<DBMeal> meals;
-		SQLite::Statement query(db_, "SELECT * FROM meals");
-		while (query.executeStep())
+			// the set is sized from the counters of the shard, a write made meanwhile only makes it grow
+			SQLite::Statement query(connection.get(), "SELECT id, name, quantity, price FROM meals ORDER BY id");
+			sets.push_back(read_meals(query, static_cast<int64_t>(shards_[i]->stats.get_totals().count), i, resource));
+		}
+		return merge_meals(sets, MealOrder::Id);
+	}
+	catch (std::exception& e)
+	{
+		throw(e);
+	}
+}
+
+/// <summary>
+/// Get the meals whose price is in [min_price_cents, max_price_cents].
+/// the range and the ordering are served by the index on the price column
+/// </summary>
+/// <param name="min_price_cents">lowest price in cents</param>
+/// <param name="max_price_cents">highest price in cents</param>
+/// <param name="sort_by_price">order the meals by ascending price</param>
+/// <param name="resource">memory of the set</param>
+/// <returns>Return the set of meals.</returns>
+DBMealSet DBSQLite::get_meals_by_price(int64_t min_price_cents, int64_t max_price_cents, bool sort_by_price, std::pmr::memory_resource* resource)
+{
+	try
+	{
+		std::vector<DBMealSet> sets;
+		sets.reserve(shards_.size());
+		for (size_t i = 0; i < shards_.size(); i++)
 		{
-			DBMeal meal;
-			meal.set_name(query.getColumn("name").getString());
-			meal.set_quantity(query.getColumn("quantity").getInt());
-			meal.set_price(query.getColumn("price").getString());
-			meals.push_back(meal);
+			ReadConnection connection(*shards_[i]);
+
+			SQLite::Statement query(connection.get(), sort_by_price ?
+				"SELECT id, name, quantity, price FROM meals WHERE price BETWEEN ? AND ? ORDER BY price, id" :
+				"SELECT id, name, quantity, price FROM meals WHERE price BETWEEN ? AND ?");
+			query.bind(1, min_price_cents);
+			query.bind(2, max_price_cents);
+			// the set is sized from the count of meals per price kept by the shard, no second scan of the index
+			sets.push_back(read_meals(query, static_cast<int64_t>(shards_[i]->stats.count_between(min_price_cents, max_price_cents)), i, resource));
 		}
-		return meals;
+		return merge_meals(sets, sort_by_price ? MealOrder::Price : MealOrder::None);
 	}
 	catch (std::exception& e)
 	{
@@ -74,6 +396,99 @@ std::list<DBMeal> DBSQLite::get_all_meals()
 	}
 }
 
+/// <summary>
+/// Read the rows of a "SELECT id, name, quantity, price" query into a DBMealSet.
+/// the names are copied straight from SQLite into the set, no string is allocated per row
+/// </summary>
+/// <param name="query">the statement to step through</param>
+/// <param name="row_count">the expected number of rows, an estimate: the set grows past it</param>
+/// <param name="shard">the shard queried, to compute the ids</param>
+/// <param name="resource">memory of the set</param>
+/// <returns>Return the set of meals.</returns>
+DBMealSet DBSQLite::read_meals(SQLite::Statement& query, int64_t row_count, size_t shard, std::pmr::memory_resource* resource)
+{
+	DBMealSet meals(resource);
+	meals.reserve(static_cast<size_t>(row_count), static_cast<size_t>(row_count) * average_name_bytes);
+	while (query.executeStep())
+	{
+		SQLite::Column name = query.getColumn(1);
+		SQLite::Column price = query.getColumn(3);
+		meals.add(global_id(shard, query.getColumn(0).getInt64()), name.getText(), name.getBytes(), query.getColumn(2).getInt(), price.getInt64(), !price.isNull());
+	}
+	return meals;
+}
+
+/// <summary>
+/// Merge the sets read from the shards, each set being already in the requested order.
+/// a k-way merge: a heap holds the next row of every set
+/// </summary>
+/// <param name="sets">one set per shard</param>
+/// <param name="order">the order of the rows in the sets</param>
+/// <returns>Return the merged set.</returns>
+DBMealSet DBSQLite::merge_meals(std::vector<DBMealSet>& sets, MealOrder order)
+{
+	if (sets.size() == 1)
+	{
+		return std::move(sets[0]);
+	}
+
+	size_t row_count = 0;
+	size_t name_bytes = 0;
+	for (const auto& set : sets)
+	{
+		row_count += set.size();
+		name_bytes += set.get_name_bytes();
+	}
+	// the merged set takes the memory of the sets
+	DBMealSet meals(sets[0].get_resource());
+	meals.reserve(row_count, name_bytes);
+
+	if (order == MealOrder::None)
+	{
+		for (const auto& set : sets)
+		{
+			for (size_t i = 0; i < set.size(); i++)
+			{
+				meals.append(set, i);
+			}
+		}
+		return meals;
+	}
+
+	// position of the next row of a set, the heap keeps the smallest row on top
+	using Head = std::pair<size_t, size_t>;
+	auto after = [&sets, order](const Head& a, const Head& b)
+		{
+			const DBMealSet::Row& x = sets[a.first][a.second];
+			const DBMealSet::Row& y = sets[b.first][b.second];
+			if (order == MealOrder::Price && x.price_cents != y.price_cents)
+			{
+				return x.price_cents > y.price_cents;
+			}
+			return x.id > y.id;
+		};
+	std::vector<Head> storage;
+	storage.reserve(sets.size());
+	std::priority_queue<Head, std::vector<Head>, decltype(after)> heads(after, std::move(storage));
+	for (size_t i = 0; i < sets.size(); i++)
+	{
+		if (!sets[i].empty())
+		{
+			heads.push(Head(i, 0));
+		}
+	}
+	while (!heads.empty())
+	{
+		Head head = heads.top();
+		heads.pop();
+		meals.append(sets[head.first], head.second);
+		if (head.second + 1 < sets[head.first].size())
+		{
+			heads.push(Head(head.first, head.second + 1));
+		}
+	}
+	return meals;
+}
 
 /// <summary>
 /// Get a meal by id
@@ -81,21 +496,36 @@ std::list<DBMeal> DBSQLite::get_all_meals()
 /// </summary>
 /// <param name="id"></param>
 /// <returns>a DBMeal class</returns>
-DBMeal DBSQLite::get_meal_by_id(int id)
+DBMeal DBSQLite::get_meal_by_id(int64_t id)
 {
 	try
 	{
+		int64_t local_id = 0;
+		Shard* shard = shard_for_id(id, local_id);
+		if (!shard)
+		{
+			throw std::runtime_error("Meal not found");
+		}
+		ReadConnection connection(*shard);
 		// Get the meal by id
 		// throw an exception if the meal is not found
 		// return the meal using a DBMeal class
-		SQLite::Statement query(db_, "SELECT * FROM meals WHERE id = ?");
-		query.bind(1, id);
+		SQLite::Statement query(connection.get(), "SELECT * FROM meals WHERE id = ?");
+		query.bind(1, local_id);
 		if (query.executeStep())
 		{
 			DBMeal meal;
+			meal.set_id(id);
 			meal.set_name(query.getColumn("name").getString());
 			meal.set_quantity(query.getColumn("quantity").getInt());
-			meal.set_price(query.getColumn("price").getString());
+			if (query.getColumn("price").isNull())
+			{
+				meal.clear_price();
+			}
+			else
+			{
+				meal.set_price_cents(query.getColumn("price").getInt64());
+			}
 			return meal;
 		}
 		else
@@ -113,13 +543,18 @@ DBMeal DBSQLite::get_meal_by_id(int id)
 /// use exception to handle the case where the meal already exists
 /// </summary>
 /// <param name="meal"></param>
-void DBSQLite::create_new_meal(const DBMeal& meal)
+/// <returns>the id of the new meal</returns>
+int64_t DBSQLite::create_new_meal(const DBMeal& meal)
 {
 	try
 	{
+		// the meal goes to the shard of its name, a meal with the same name can only be there
+		size_t index = shard_for_name(meal.get_name());
+		Shard& shard = *shards_[index];
+		std::lock_guard<std::mutex> lock(shard.write_mutex);
 		// test if the meal already exists
 		// throw an exception if the meal already exists
-		SQLite::Statement query(db_, "SELECT * FROM meals WHERE name = ?");
+		SQLite::Statement query(shard.db, "SELECT * FROM meals WHERE name = ?");
 		query.bind(1, meal.get_name());
 		if (query.executeStep())
 		{
@@ -127,11 +562,14 @@ void DBSQLite::create_new_meal(const DBMeal& meal)
 		}
 
 		// Insert the meal into the table meals
-		SQLite::Statement querynew(db_, "INSERT INTO meals (name, quantity, price) VALUES (?, ?, ?)");
+		SQLite::Statement querynew(shard.db, "INSERT INTO meals (name, quantity, price) VALUES (?, ?, ?)");
 		querynew.bind(1, meal.get_name());
 		querynew.bind(2, meal.get_quantity());
-		querynew.bind(3, meal.get_price());
+		querynew.bind(3, meal.get_price_cents());
 		querynew.exec();
+		shard.stats.add(meal.get_quantity(), meal.get_price_cents());
+		shard.writes++;
+		return global_id(index, shard.db.getLastInsertRowid());
 	}
 	catch (std::exception& e)
 	{
@@ -143,17 +581,45 @@ void DBSQLite::create_new_meal(const DBMeal& meal)
 /// </summary>
 /// <param name="id">the id</param>
 /// <returns>200 if the meal is deleted</returns>
-int DBSQLite::delete_mail_by_id(int id)
+int DBSQLite::delete_mail_by_id(int64_t id)
 {
 	try
 	{
+		int64_t local_id = 0;
+		Shard* shard = shard_for_id(id, local_id);
+		if (!shard)
+		{
+			return 200;
+		}
+		std::lock_guard<std::mutex> lock(shard->write_mutex);
 		// Create new SQLite::Statement query to delete the meal by id
 		// throw an exception if the meal is not found
 		// return 200 if the meal is deleted
 		// return exception if the meal is not found
-		SQLite::Statement query(db_, "DELETE FROM meals WHERE id = ?");
-		query.bind(1, id);
+		// read the meal first to remove it from the aggregates
+		SQLite::Statement meal(shard->db, "SELECT quantity, price FROM meals WHERE id = ?");
+		meal.bind(1, local_id);
+		if (!meal.executeStep())
+		{
+			return 200;
+		}
+		int64_t quantity = meal.getColumn(0).getInt64();
+		int64_t price_cents = meal.getColumn(1).getInt64();
+		bool priced = !meal.getColumn(1).isNull();
+		meal.reset();
+
+		SQLite::Statement query(shard->db, "DELETE FROM meals WHERE id = ?");
+		query.bind(1, local_id);
 		query.exec();
+		if (priced)
+		{
+			shard->stats.remove(quantity, price_cents);
+		}
+		else
+		{
+			shard->stats.remove_unpriced();
+		}
+		shard->writes++;
 		return 200;
 	}
 	catch (std::exception& e)
@@ -161,6 +627,128 @@ int DBSQLite::delete_mail_by_id(int id)
 		throw(e);
 	}
 }
+/// <summary>
+/// Copy the database into a folder while it keeps serving requests.
+/// the SQLite online backup API copies a few pages per step and the source is only
+/// locked during a step. The write connection is the source so that the writes made
+/// between two steps are applied to the copy instead of restarting the backup.
+/// </summary>
+/// <param name="folder">the destination folder, the files keep the names of the shards</param>
+/// <param name="pacing">pages per step and pause between the steps, updated with the measures</param>
+void DBSQLite::backup_to(const std::string& folder, BackupPacing& pacing)
+{
+	pacing.steps = 0;
+	pacing.longest_step = std::chrono::microseconds(0);
+
+	for (auto& shard : shards_)
+	{
+		fs::path target = fs::path(folder) / fs::path(shard->file_name).filename();
+		SQLite::Database destination(target.string(), SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+		SQLite::Backup backup(destination, shard->db);
+		for (;;)
+		{
+			auto start = std::chrono::steady_clock::now();
+			int result = backup.executeStep(pacing.pages_per_step);
+			auto step = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+			pacing.steps++;
+			pacing.longest_step = std::max(pacing.longest_step, step);
+			if (step > pacing.max_step)
+			{
+				pacing.pages_per_step = std::max(1, pacing.pages_per_step / 2);
+			}
+			else if (step < pacing.max_step / 4)
+			{
+				pacing.pages_per_step = std::min(pacing.max_pages_per_step, pacing.pages_per_step * 2);
+			}
+
+			if (result == SQLITE_DONE)
+			{
+				break;
+			}
+			std::this_thread::sleep_for(pacing.pause);
+		}
+	}
+}
+
+/// <summary>
+/// Get the aggregates of all the meals from the counters of the shards, no table is read
+/// </summary>
+/// <returns>the aggregates</returns>
+MealStats::Totals DBSQLite::get_stats()
+{
+	MealStats::Totals totals;
+	for (auto& shard : shards_)
+	{
+		totals.merge(shard->stats.get_totals());
+	}
+	return totals;
+}
+
+/// <summary>
+/// Compare the counters of every shard with the aggregates computed by SQLite.
+/// the aggregates are computed on a read connection while the writes go on, the writes only
+/// wait for the comparison. A scan overlapping a write is done again: the count of writes of
+/// the shard must be the same before the scan and once the writes are locked out.
+/// </summary>
+/// <returns>false if the counters of a shard were wrong</returns>
+bool DBSQLite::verify_stats()
+{
+	bool valid = true;
+	for (auto& shard : shards_)
+	{
+		for (int attempt = 0; attempt < stats_check_attempts; attempt++)
+		{
+			uint64_t writes = shard->writes;
+			MealStats stats;
+			{
+				ReadConnection connection(*shard);
+				load_stats(connection.get(), stats);
+			}
+
+			std::lock_guard<std::mutex> lock(shard->write_mutex);
+			if (shard->writes != writes)
+			{
+				continue;
+			}
+			if (stats.get_totals() != shard->stats.get_totals())
+			{
+				CROW_LOG_WARNING << "Meal statistics of " << shard->file_name << " were out of date";
+				shard->stats.assign(stats);
+				valid = false;
+			}
+			break;
+		}
+	}
+	return valid;
+}
+
+/// <summary>
+/// Compute the aggregates of the meals of a shard, one row per price read from the price index
+/// the meals without a price come as one row with a NULL price
+/// </summary>
+/// <param name="connection">a connection to the shard</param>
+/// <param name="stats">the aggregates to fill</param>
+void DBSQLite::load_stats(SQLite::Database& connection, MealStats& stats)
+{
+	stats.clear();
+	if (!connection.tableExists("meals"))
+	{
+		return;
+	}
+	SQLite::Statement query(connection, "SELECT price, COUNT(*), SUM(quantity) FROM meals GROUP BY price");
+	while (query.executeStep())
+	{
+		uint64_t count = static_cast<uint64_t>(query.getColumn(1).getInt64());
+		if (query.getColumn(0).isNull())
+		{
+			stats.add_unpriced(count);
+			continue;
+		}
+		stats.add(query.getColumn(2).getInt64(), query.getColumn(0).getInt64(), count);
+	}
+}
+
 #pragma region database creation
 
 /// <summary>
@@ -171,18 +759,24 @@ void DBSQLite::drop_table_meals()
 {
 	try
 	{
-		// test if the table meals exists
-		// throw an exception if the table does not exist
-		// Drop the table meals if the table exists
-		SQLite::Statement query(db_, "SELECT name FROM sqlite_master WHERE type='table' AND name='meals'");
-		if (query.executeStep())
+		for (auto& shard : shards_)
 		{
+			std::lock_guard<std::mutex> lock(shard->write_mutex);
+			// test if the table meals exists
+			// throw an exception if the table does not exist
 			// Drop the table meals if the table exists
-			db_.exec("DROP TABLE meals");
-		}
-		else
-		{
-			throw std::runtime_error("Table does not exist");
+			SQLite::Statement query(shard->db, "SELECT name FROM sqlite_master WHERE type='table' AND name='meals'");
+			if (query.executeStep())
+			{
+				// Drop the table meals if the table exists
+				shard->db.exec("DROP TABLE meals");
+				shard->stats.clear();
+				shard->writes++;
+			}
+			else
+			{
+				throw std::runtime_error("Table does not exist");
+			}
 		}
 	}
 	catch (std::exception& e)
@@ -191,19 +785,36 @@ void DBSQLite::drop_table_meals()
 	}
 }
 /// <summary>
-/// Creates the table "meals" if it does not exist and inserts data from data_db file into the table.
+/// Creates the table "meals" in every shard if it does not exist and inserts data from data_db file into the table.
+/// the rows of the file are spread over the shards like the new meals
 /// </summary>
 void DBSQLite::create_table_if_not_exist()
 {
 	// If the file meals.csv does not exist, return
 	if (fs::exists(data_db))
 	{
-		//test if the table meals exists
-		SQLite::Statement query(db_, "SELECT name FROM sqlite_master WHERE type='table' AND name='meals'");
-		if (!query.executeStep())
+		//test if the table meals exists, the file is loaded when the table is created in every shard
+		// a shard without the table next to shards holding meals would get the lookups of some names wrong
+		size_t created = 0;
+		for (size_t i = 0; i < shards_.size(); i++)
+		{
+			SQLite::Statement query(shards_[i]->db, "SELECT name FROM sqlite_master WHERE type='table' AND name='meals'");
+			if (!query.executeStep())
+			{
+				created++;
+			}
+		}
+		if (created != 0 && created != shards_.size())
+		{
+			throw std::runtime_error("the table meals is missing from " + std::to_string(created) + " of the " + std::to_string(shards_.size()) + " shards");
+		}
+		for (auto& shard : shards_)
 		{
 			// Create the table meals if the table does not exist
-			db_.exec("CREATE TABLE meals (id INTEGER PRIMARY KEY, name TEXT, quantity INTEGER, price TEXT)");
+			shard->db.exec("CREATE TABLE IF NOT EXISTS meals (id INTEGER PRIMARY KEY, name TEXT, quantity INTEGER, price INTEGER)");
+		}
+		if (created != 0)
+		{
 
 			// Vector of vector of string to store the data
 			// ifstream to read the data from the file meals.txt
@@ -229,13 +840,89 @@ void DBSQLite::create_table_if_not_exist()
 
 			// Insert the data into the table meals
 			for (int i = 0; i < data.size(); i++) {
-				SQLite::Statement query(db_, "INSERT INTO meals (name, quantity, price) VALUES (?, ?, ?)");
+				int64_t price_cents = 0;
+				if (!Utility::parse_price(data[i][2], price_cents))
+				{
+					throw std::runtime_error("Invalid price " + data[i][2] + " in " + data_db);
+				}
+				SQLite::Statement query(shards_[shard_for_name(data[i][0])]->db, "INSERT INTO meals (name, quantity, price) VALUES (?, ?, ?)");
 				query.bind(1, data[i][0]);
 				query.bind(2, std::stoi(data[i][1]));
-				query.bind(3, data[i][2]);
+				query.bind(3, price_cents);
 				query.exec();
 			}
 		}
 	}
+}
+/// <summary>
+/// Upgrade a shard created by a previous version.
+/// the price column used to be TEXT, it is rewritten as INTEGER cents
+/// then the index used by the price range queries is created.
+/// </summary>
+void DBSQLite::upgrade_schema(Shard& shard)
+{
+	// look for the declared type of the price column, nothing to do if the table does not exist
+	std::string price_type;
+	SQLite::Statement columns(shard.db, "PRAGMA table_info(meals)");
+	while (columns.executeStep())
+	{
+		if (columns.getColumn("name").getString() == "price")
+		{
+			price_type = columns.getColumn("type").getString();
+		}
+	}
+	if (price_type.empty())
+	{
+		return;
+	}
+
+	if (price_type == "TEXT")
+	{
+		// SQLite cannot change the type of a column: copy the rows into a new table
+		// the text prices are parsed here rather than with CAST(... AS REAL) to avoid rounding errors
+		// the old code stored any string as a price: a meal whose price cannot be parsed keeps a NULL
+		// price and its text is kept in meals_invalid_prices to be fixed by hand
+		SQLite::Transaction transaction(shard.db);
+		shard.db.exec("CREATE TABLE meals_upgrade (id INTEGER PRIMARY KEY, name TEXT, quantity INTEGER, price INTEGER)");
+		shard.db.exec("CREATE TABLE IF NOT EXISTS meals_invalid_prices (id INTEGER PRIMARY KEY, price TEXT)");
+
+		SQLite::Statement query(shard.db, "SELECT id, name, quantity, price FROM meals");
+		SQLite::Statement insert(shard.db, "INSERT INTO meals_upgrade (id, name, quantity, price) VALUES (?, ?, ?, ?)");
+		SQLite::Statement invalid(shard.db, "INSERT OR REPLACE INTO meals_invalid_prices (id, price) VALUES (?, ?)");
+		size_t invalid_count = 0;
+		while (query.executeStep())
+		{
+			std::string price = query.getColumn(3).getString();
+			int64_t price_cents = 0;
+			insert.bind(1, query.getColumn(0).getInt64());
+			insert.bind(2, query.getColumn(1).getString());
+			insert.bind(3, query.getColumn(2).getInt());
+			if (Utility::parse_price(price, price_cents))
+			{
+				insert.bind(4, price_cents);
+			}
+			else
+			{
+				insert.bind(4);
+				invalid.bind(1, query.getColumn(0).getInt64());
+				invalid.bind(2, price);
+				invalid.exec();
+				invalid.reset();
+				invalid_count++;
+			}
+			insert.exec();
+			insert.reset();
+		}
+
+		shard.db.exec("DROP TABLE meals");
+		shard.db.exec("ALTER TABLE meals_upgrade RENAME TO meals");
+		transaction.commit();
+		if (invalid_count != 0)
+		{
+			CROW_LOG_WARNING << invalid_count << " meals of " << shard.file_name << " have an invalid price, set to NULL, see the table meals_invalid_prices";
+		}
+	}
+
+	shard.db.exec("CREATE INDEX IF NOT EXISTS meals_price_idx ON meals (price)");
 #pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "Executor.h"
+
+/// <summary>
+/// Starts the threads of the executor
+/// </summary>
+/// <param name="thread_count">number of threads</param>
+/// <param name="queue_capacity">number of tasks that can wait for a thread</param>
+Executor::Executor(size_t thread_count, size_t queue_capacity) : capacity_(queue_capacity)
+{
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		threads_.emplace_back(&Executor::run, this);
+	}
+}
+
+/// <summary>
+/// Runs the tasks still queued then stops the threads
+/// </summary>
+Executor::~Executor()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	ready_.notify_all();
+	for (auto& thread : threads_)
+	{
+		thread.join();
+	}
+}
+
+/// <summary>
+/// Queues a task
+/// </summary>
+/// <param name="task">the task</param>
+/// <returns>false if the queue is full or the executor is stopping</returns>
+bool Executor::submit(std::function<void()> task)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (stopping_ || queue_.size() >= capacity_)
+		{
+			return false;
+		}
+		queue_.push_back(std::move(task));
+	}
+	ready_.notify_one();
+	return true;
+}
+
+/// <summary>
+/// Gets the number of tasks waiting for a thread
+/// </summary>
+size_t Executor::pending()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	return queue_.size();
+}
+
+void Executor::run()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+			if (queue_.empty())
+			{
+				return;
+			}
+			task = std::move(queue_.front());
+			queue_.pop_front();
+		}
+		task();
+	}
+}
\ No newline at end of file
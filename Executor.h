@@ -0,0 +1,39 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Executor runs tasks on a fixed set of threads fed by a bounded queue.
+/// submit() never blocks: when the queue is full the task is refused and
+/// the caller answers right away instead of piling up work.
+/// </summary>
+class Executor
+{
+public:
+	Executor(size_t thread_count, size_t queue_capacity);
+	~Executor();
+
+	bool submit(std::function<void()> task);
+	size_t pending();
+
+private:
+	Executor(const Executor&) = delete;
+	Executor& operator=(const Executor&) = delete;
+
+	void run();
+
+	std::vector<std::thread>			threads_;
+	std::deque<std::function<void()>>	queue_;
+	size_t								capacity_;
+	std::mutex							mutex_;
+	std::condition_variable				ready_;
+	bool								stopping_ = false;
+};
+
+#endif
\ No newline at end of file
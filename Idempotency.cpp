@@ -0,0 +1,196 @@
+#include <algorithm>
+#include "Idempotency.h"
+
+/// <summary>
+/// Time in seconds since the epoch, the saved responses outlive the process
+/// </summary>
+static int64_t unix_time()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/// <summary>
+/// Create the store, the saved responses still valid are loaded when a file is given
+/// </summary>
+/// <param name="capacity">maximum number of keys</param>
+/// <param name="ttl">time a key is kept</param>
+/// <param name="file_name">SQLite file saving the responses, empty to keep them in memory only</param>
+IdempotencyStore::IdempotencyStore(size_t capacity, std::chrono::seconds ttl, const std::string& file_name)
+	: bucket_capacity_(std::max<size_t>(1, capacity / bucket_count)), ttl_(ttl), buckets_(bucket_count)
+{
+	if (!file_name.empty())
+	{
+		file_ = std::make_unique<SQLite::Database>(file_name, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+		file_->exec("CREATE TABLE IF NOT EXISTS idempotency_keys (key TEXT PRIMARY KEY, fingerprint INTEGER, code INTEGER, content_type TEXT, body TEXT, expires INTEGER)");
+		file_->exec("CREATE INDEX IF NOT EXISTS idempotency_keys_expires_idx ON idempotency_keys (expires)");
+		load();
+	}
+}
+
+/// <summary>
+/// Look up a key when a request starts
+/// </summary>
+/// <param name="key">the Idempotency-Key of the request</param>
+/// <param name="fingerprint">hash of the request body</param>
+/// <param name="stored">the response to send again when the result is Replay</param>
+/// <returns>what to do with the request</returns>
+IdempotencyStore::Claim IdempotencyStore::begin(const std::string& key, uint64_t fingerprint, Response& stored)
+{
+	Bucket& bucket = bucket_for(key);
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+
+	auto found = bucket.entries.find(key);
+	if (found != bucket.entries.end() && found->second.expires > std::chrono::steady_clock::now())
+	{
+		const Entry& entry = found->second;
+		if (entry.fingerprint != fingerprint)
+		{
+			return Claim::Mismatch;
+		}
+		if (!entry.completed)
+		{
+			return Claim::InProgress;
+		}
+		stored = entry.response;
+		return Claim::Replay;
+	}
+
+	insert(bucket, key, Entry{ fingerprint, false, Response(), std::chrono::steady_clock::now() + ttl_ });
+	return Claim::Started;
+}
+
+/// <summary>
+/// Store the response of a request started with begin()
+/// </summary>
+void IdempotencyStore::complete(const std::string& key, uint64_t fingerprint, const Response& response)
+{
+	{
+		Bucket& bucket = bucket_for(key);
+		std::lock_guard<std::mutex> lock(bucket.mutex);
+		auto found = bucket.entries.find(key);
+		if (found != bucket.entries.end())
+		{
+			found->second.completed = true;
+			found->second.response = response;
+		}
+		else
+		{
+			// evicted while the request was running
+			insert(bucket, key, Entry{ fingerprint, true, response, std::chrono::steady_clock::now() + ttl_ });
+		}
+	}
+	if (file_)
+	{
+		save(key, fingerprint, response);
+	}
+}
+
+/// <summary>
+/// Forget a key whose request did not run (server busy, rate limited) so that it can be retried
+/// </summary>
+void IdempotencyStore::abandon(const std::string& key)
+{
+	Bucket& bucket = bucket_for(key);
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+	bucket.entries.erase(key);
+}
+
+IdempotencyStore::Bucket& IdempotencyStore::bucket_for(const std::string& key)
+{
+	return buckets_[std::hash<std::string>()(key) % bucket_count];
+}
+
+/// <summary>
+/// Add a key to a bucket, the bucket lock must be held.
+/// the keys are kept for the same time so the oldest keys are the first to expire:
+/// expired keys are dropped from the front then the oldest one if the bucket is full.
+/// A key found with another expiry time was abandoned or added again, it is only removed from the order
+/// </summary>
+void IdempotencyStore::insert(Bucket& bucket, const std::string& key, Entry entry)
+{
+	auto now = std::chrono::steady_clock::now();
+	while (!bucket.order.empty())
+	{
+		const auto& oldest = bucket.order.front();
+		auto found = bucket.entries.find(oldest.first);
+		bool current = found != bucket.entries.end() && found->second.expires == oldest.second;
+		if (current && oldest.second > now && bucket.entries.size() < bucket_capacity_)
+		{
+			break;
+		}
+		if (current)
+		{
+			bucket.entries.erase(found);
+		}
+		bucket.order.pop_front();
+	}
+
+	bucket.order.emplace_back(key, entry.expires);
+	bucket.entries[key] = std::move(entry);
+
+	// the records of the abandoned keys and of the keys added again stay in the order until they
+	// reach the front, drop them once they outnumber the keys so that the order stays bounded
+	if (bucket.order.size() > 2 * bucket_capacity_)
+	{
+		std::deque<std::pair<std::string, std::chrono::steady_clock::time_point>> order;
+		for (auto& record : bucket.order)
+		{
+			auto found = bucket.entries.find(record.first);
+			if (found != bucket.entries.end() && found->second.expires == record.second)
+			{
+				order.push_back(std::move(record));
+			}
+		}
+		bucket.order.swap(order);
+	}
+}
+
+/// <summary>
+/// Load the saved responses that have not expired
+/// </summary>
+void IdempotencyStore::load()
+{
+	int64_t now = unix_time();
+	SQLite::Statement expired(*file_, "DELETE FROM idempotency_keys WHERE expires <= ?");
+	expired.bind(1, now);
+	expired.exec();
+
+	SQLite::Statement query(*file_, "SELECT key, fingerprint, code, content_type, body, expires FROM idempotency_keys ORDER BY expires");
+	while (query.executeStep())
+	{
+		std::string key = query.getColumn(0).getString();
+		Entry entry;
+		entry.fingerprint = static_cast<uint64_t>(query.getColumn(1).getInt64());
+		entry.completed = true;
+		entry.response.code = query.getColumn(2).getInt();
+		entry.response.content_type = query.getColumn(3).getString();
+		entry.response.body = query.getColumn(4).getString();
+		entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(query.getColumn(5).getInt64() - now);
+
+		Bucket& bucket = bucket_for(key);
+		std::lock_guard<std::mutex> lock(bucket.mutex);
+		insert(bucket, key, std::move(entry));
+	}
+}
+
+/// <summary>
+/// Save a response to the file and remove the expired ones
+/// </summary>
+void IdempotencyStore::save(const std::string& key, uint64_t fingerprint, const Response& response)
+{
+	int64_t now = unix_time();
+	std::lock_guard<std::mutex> lock(file_mutex_);
+
+	SQLite::Statement query(*file_, "INSERT OR REPLACE INTO idempotency_keys (key, fingerprint, code, content_type, body, expires) VALUES (?, ?, ?, ?, ?, ?)");
+	query.bind(1, key);
+	query.bind(2, static_cast<int64_t>(fingerprint));
+	query.bind(3, response.code);
+	query.bind(4, response.content_type);
+	query.bind(5, response.body);
+	query.bind(6, now + static_cast<int64_t>(ttl_.count()));
+	query.exec();
+
+	SQLite::Statement expired(*file_, "DELETE FROM idempotency_keys WHERE expires <= ?");
+	expired.bind(1, now);
+	expired.exec();
+}
\ No newline at end of file
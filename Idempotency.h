@@ -0,0 +1,80 @@
+#ifndef IDEMPOTENCY_H
+#define IDEMPOTENCY_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <SQLiteCpp/SQLiteCpp.h>
+
+/// <summary>
+/// IdempotencyStore remembers the response sent for an Idempotency-Key so that a retried
+/// request gets the same response without running again. The keys are spread over buckets
+/// with their own lock, each bucket holds a bounded number of keys kept for a fixed time,
+/// the oldest key is evicted first. The responses can also be saved to a SQLite file to
+/// survive a restart.
+/// </summary>
+class IdempotencyStore
+{
+public:
+	struct Response
+	{
+		int			code = 0;
+		std::string	content_type;
+		std::string	body;
+	};
+
+	enum class Claim
+	{
+		Started,		// new key, the request must run then call complete() or abandon()
+		Replay,			// the stored response must be sent
+		InProgress,		// the first request with this key is still running
+		Mismatch		// the key was used with another request body
+	};
+
+	IdempotencyStore(size_t capacity, std::chrono::seconds ttl, const std::string& file_name = "");
+
+	Claim begin(const std::string& key, uint64_t fingerprint, Response& stored);
+	void complete(const std::string& key, uint64_t fingerprint, const Response& response);
+	void abandon(const std::string& key);
+
+private:
+	IdempotencyStore(const IdempotencyStore&) = delete;
+	IdempotencyStore& operator=(const IdempotencyStore&) = delete;
+
+	struct Entry
+	{
+		uint64_t								fingerprint;
+		bool									completed;
+		Response								response;
+		std::chrono::steady_clock::time_point	expires;
+	};
+
+	struct Bucket
+	{
+		std::mutex								mutex;
+		std::unordered_map<std::string, Entry>	entries;
+		std::deque<std::pair<std::string, std::chrono::steady_clock::time_point>>	order;	// keys from the oldest to the newest
+	};
+
+	Bucket& bucket_for(const std::string& key);
+	void insert(Bucket& bucket, const std::string& key, Entry entry);
+	void load();
+	void save(const std::string& key, uint64_t fingerprint, const Response& response);
+
+	static const size_t					bucket_count = 16;
+
+	size_t								bucket_capacity_;
+	std::chrono::seconds				ttl_;
+	std::vector<Bucket>					buckets_;
+
+	std::mutex							file_mutex_;
+	std::unique_ptr<SQLite::Database>	file_;		// saved responses, null when not persisted
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+#ifndef MEALJSON_H
+#define MEALJSON_H
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+#include "utility.h"
+
+/// <summary>
+/// Append a JSON string to a response body, escaping quotes, backslashes and control characters
+/// </summary>
+/// <param name="out">the response body, a std::string or a std::pmr::string</param>
+/// <param name="text">the string to append</param>
+template <class String>
+static void append_json_string(String& out, std::string_view text)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	out += '"';
+	size_t start = 0;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		unsigned char c = static_cast<unsigned char>(text[i]);
+		if (c >= 0x20 && c != '"' && c != '\\')
+		{
+			continue;
+		}
+		out.append(text.data() + start, i - start);
+		switch (c)
+		{
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			out += "\\u00";
+			out += hex[c >> 4];
+			out += hex[c & 0xf];
+		}
+		start = i + 1;
+	}
+	out.append(text.data() + start, text.size() - start);
+	out += '"';
+}
+
+/// <summary>
+/// Append a meal as a JSON object to a response body: {"id":7,"name":"...","quantity":1,"price":"12.45"}
+/// </summary>
+/// <param name="out">the response body, a std::string or a std::pmr::string</param>
+/// <param name="has_price">false for a meal without a price, written as "price":null</param>
+template <class String>
+static void append_meal_json(String& out, int64_t id, std::string_view name, int quantity, bool has_price, int64_t price_cents)
+{
+	char number[24];
+
+	out += "{\"id\":";
+	out.append(number, std::to_chars(number, number + sizeof(number), id).ptr);
+	out += ",\"name\":";
+	append_json_string(out, name);
+	out += ",\"quantity\":";
+	out.append(number, std::to_chars(number, number + sizeof(number), quantity).ptr);
+	if (!has_price)
+	{
+		out += ",\"price\":null}";
+		return;
+	}
+	out += ",\"price\":\"";
+	out.append(number, Utility::format_price(price_cents, number));
+	out += "\"}";
+}
+
+#endif
\ No newline at end of file
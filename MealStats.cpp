@@ -0,0 +1,134 @@
+#include <algorithm>
+#include "MealStats.h"
+
+/// <summary>
+/// Get the price range of a price
+/// </summary>
+size_t MealStats::price_range(int64_t price_cents)
+{
+	return static_cast<size_t>(std::upper_bound(price_bounds.begin(), price_bounds.end(), price_cents) - price_bounds.begin());
+}
+
+/// <summary>
+/// Count meals with the same price
+/// </summary>
+/// <param name="quantity">the total quantity of the meals</param>
+/// <param name="price_cents">the price of the meals</param>
+/// <param name="count">the number of meals</param>
+void MealStats::add(int64_t quantity, int64_t price_cents, uint64_t count)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	totals_.count += count;
+	totals_.total_quantity += quantity;
+	totals_.total_price_cents += price_cents * static_cast<int64_t>(count);
+	totals_.price_ranges[price_range(price_cents)] += count;
+	prices_[price_cents] += count;
+	totals_.min_price_cents = prices_.begin()->first;
+	totals_.max_price_cents = prices_.rbegin()->first;
+}
+
+/// <summary>
+/// Remove a meal
+/// </summary>
+void MealStats::remove(int64_t quantity, int64_t price_cents)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto price = prices_.find(price_cents);
+	if (price == prices_.end())
+	{
+		return;
+	}
+	if (--price->second == 0)
+	{
+		prices_.erase(price);
+	}
+	totals_.count--;
+	totals_.total_quantity -= quantity;
+	totals_.total_price_cents -= price_cents;
+	totals_.price_ranges[price_range(price_cents)]--;
+	totals_.min_price_cents = prices_.empty() ? 0 : prices_.begin()->first;
+	totals_.max_price_cents = prices_.empty() ? 0 : prices_.rbegin()->first;
+}
+
+/// <summary>
+/// Count meals without a price
+/// </summary>
+void MealStats::add_unpriced(uint64_t count)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	totals_.unpriced += count;
+}
+
+void MealStats::remove_unpriced()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (totals_.unpriced != 0)
+	{
+		totals_.unpriced--;
+	}
+}
+
+void MealStats::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	totals_ = Totals();
+	prices_.clear();
+}
+
+/// <summary>
+/// Replace the aggregates by the ones of another MealStats
+/// </summary>
+void MealStats::assign(const MealStats& other)
+{
+	std::scoped_lock lock(mutex_, other.mutex_);
+	totals_ = other.totals_;
+	prices_ = other.prices_;
+}
+
+MealStats::Totals MealStats::get_totals() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return totals_;
+}
+
+/// <summary>
+/// Get the number of meals whose price is in [min_price_cents, max_price_cents],
+/// read from the count of meals per price without touching the tables
+/// </summary>
+uint64_t MealStats::count_between(int64_t min_price_cents, int64_t max_price_cents) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	uint64_t count = 0;
+	for (auto price = prices_.lower_bound(min_price_cents); price != prices_.end() && price->first <= max_price_cents; ++price)
+	{
+		count += price->second;
+	}
+	return count;
+}
+
+/// <summary>
+/// Add the aggregates of another set of meals
+/// </summary>
+void MealStats::Totals::merge(const Totals& other)
+{
+	unpriced += other.unpriced;
+	if (other.count == 0)
+	{
+		return;
+	}
+	min_price_cents = count == 0 ? other.min_price_cents : std::min(min_price_cents, other.min_price_cents);
+	max_price_cents = count == 0 ? other.max_price_cents : std::max(max_price_cents, other.max_price_cents);
+	count += other.count;
+	total_quantity += other.total_quantity;
+	total_price_cents += other.total_price_cents;
+	for (size_t i = 0; i < price_ranges.size(); i++)
+	{
+		price_ranges[i] += other.price_ranges[i];
+	}
+}
+
+bool MealStats::Totals::operator==(const Totals& other) const
+{
+	return count == other.count && total_quantity == other.total_quantity && total_price_cents == other.total_price_cents
+		&& min_price_cents == other.min_price_cents && max_price_cents == other.max_price_cents && price_ranges == other.price_ranges && unpriced == other.unpriced;
+}
\ No newline at end of file
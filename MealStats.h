@@ -0,0 +1,54 @@
+#ifndef MEALSTATS_H
+#define MEALSTATS_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+/// <summary>
+/// MealStats keeps the aggregates of a set of meals up to date as meals are added and removed:
+/// the number of meals, the total stock, the sum of the prices and the number of meals per
+/// price range. The count of meals per price gives the lowest and highest price after a removal.
+/// Reading the aggregates does not depend on the number of meals. A meal without a price
+/// (a legacy price that could not be converted) is only counted in unpriced.
+/// </summary>
+class MealStats
+{
+public:
+	// upper bounds in cents of the price ranges, the last range has no upper bound
+	static constexpr std::array<int64_t, 6> price_bounds{ 500, 1000, 1500, 2000, 3000, 5000 };
+
+	struct Totals
+	{
+		uint64_t	count = 0;
+		int64_t		total_quantity = 0;
+		int64_t		total_price_cents = 0;
+		int64_t		min_price_cents = 0;	// 0 when there is no meal
+		int64_t		max_price_cents = 0;
+		std::array<uint64_t, price_bounds.size() + 1> price_ranges{};
+		uint64_t	unpriced = 0;			// meals without a price, left out of the other aggregates
+
+		void merge(const Totals& other);
+		bool operator==(const Totals& other) const;
+		bool operator!=(const Totals& other) const { return !(*this == other); }
+	};
+
+	void add(int64_t quantity, int64_t price_cents, uint64_t count = 1);
+	void remove(int64_t quantity, int64_t price_cents);
+	void add_unpriced(uint64_t count = 1);
+	void remove_unpriced();
+	void clear();
+	void assign(const MealStats& other);
+	Totals get_totals() const;
+	uint64_t count_between(int64_t min_price_cents, int64_t max_price_cents) const;
+
+private:
+	static size_t price_range(int64_t price_cents);
+
+	mutable std::mutex				mutex_;
+	Totals							totals_;
+	std::map<int64_t, uint64_t>		prices_;	// number of meals per price
+};
+
+#endif
\ No newline at end of file
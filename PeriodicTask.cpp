@@ -0,0 +1,36 @@
+#include <crow.h>
+#include "PeriodicTask.h"
+
+PeriodicTask::PeriodicTask(std::chrono::seconds interval, std::function<void()> task)
+	: interval_(interval), task_(std::move(task))
+{
+	thread_ = std::thread(&PeriodicTask::run, this);
+}
+
+PeriodicTask::~PeriodicTask()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wakeup_.notify_all();
+	thread_.join();
+}
+
+void PeriodicTask::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!wakeup_.wait_for(lock, interval_, [this] { return stopping_; }))
+	{
+		lock.unlock();
+		try
+		{
+			task_();
+		}
+		catch (const std::exception& error)
+		{
+			CROW_LOG_WARNING << "Periodic task failed: " << error.what();
+		}
+		lock.lock();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef PERIODICTASK_H
+#define PERIODICTASK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// <summary>
+/// PeriodicTask runs a task on its own thread every interval until it is destroyed
+/// </summary>
+class PeriodicTask
+{
+public:
+	PeriodicTask(std::chrono::seconds interval, std::function<void()> task);
+	~PeriodicTask();
+
+private:
+	PeriodicTask(const PeriodicTask&) = delete;
+	PeriodicTask& operator=(const PeriodicTask&) = delete;
+
+	void run();
+
+	std::chrono::seconds		interval_;
+	std::function<void()>		task_;
+	std::mutex					mutex_;
+	std::condition_variable		wakeup_;
+	bool						stopping_ = false;
+	std::thread					thread_;	// last member, started once the others are ready
+};
+
+#endif
\ No newline at end of file
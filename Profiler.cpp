@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include "Profiler.h"
+
+// Number of requests kept per thread
+static const size_t ring_size = 256;
+
+/// <summary>
+/// The last requests completed by a thread. The lock is only shared with /debug/slow,
+/// the owner thread takes it uncontended
+/// </summary>
+struct ProfileRing
+{
+	std::mutex										mutex;
+	std::array<RequestProfile::Sample, ring_size>	samples;
+	size_t											next = 0;
+};
+
+// The rings of all the threads, a ring outlives its thread so that it can still be read
+static std::mutex rings_mutex;
+static std::vector<std::shared_ptr<ProfileRing>> rings;
+
+/// <summary>
+/// Gets the ring of the calling thread, created on first use
+/// </summary>
+static ProfileRing& get_ring()
+{
+	thread_local std::shared_ptr<ProfileRing> ring = []()
+		{
+			auto created = std::make_shared<ProfileRing>();
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			rings.push_back(created);
+			return created;
+		}();
+	return *ring;
+}
+
+RequestProfile::RequestProfile(const char* route) : start_(std::chrono::steady_clock::now()), last_(start_)
+{
+	sample_.route = route;
+}
+
+/// <summary>
+/// Add the time elapsed since the previous mark to a stage
+/// </summary>
+void RequestProfile::mark(Stage stage)
+{
+	auto now = std::chrono::steady_clock::now();
+	sample_.stages[stage] += now - last_;
+	last_ = now;
+}
+
+/// <summary>
+/// Record the request in the ring of the calling thread, the oldest request is overwritten
+/// </summary>
+/// <param name="code">the status code of the response</param>
+void RequestProfile::record(int code)
+{
+	sample_.code = code;
+	sample_.finished = std::chrono::steady_clock::now();
+	sample_.total = sample_.finished - start_;
+
+	ProfileRing& ring = get_ring();
+	std::lock_guard<std::mutex> lock(ring.mutex);
+	ring.samples[ring.next] = sample_;
+	ring.next = (ring.next + 1) % ring_size;
+}
+
+const char* RequestProfile::get_stage_name(Stage stage)
+{
+	switch (stage)
+	{
+	case Limiter: return "limiter";
+	case Queue: return "queue";
+	case Database: return "sqlite";
+	case Serialization: return "serialization";
+	case Span: return "span";
+	default: return "unknown";
+	}
+}
+
+/// <summary>
+/// Gets the slowest of the requests kept by all the threads
+/// </summary>
+/// <param name="count">maximum number of requests</param>
+/// <returns>the requests, the slowest first</returns>
+std::vector<RequestProfile::Sample> RequestProfile::get_slowest(size_t count)
+{
+	std::vector<std::shared_ptr<ProfileRing>> all;
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		all = rings;
+	}
+
+	std::vector<Sample> samples;
+	samples.reserve(all.size() * ring_size);
+	for (const auto& ring : all)
+	{
+		std::lock_guard<std::mutex> lock(ring->mutex);
+		for (const Sample& sample : ring->samples)
+		{
+			if (sample.route)
+			{
+				samples.push_back(sample);
+			}
+		}
+	}
+
+	count = std::min(count, samples.size());
+	std::partial_sort(samples.begin(), samples.begin() + count, samples.end(),
+		[](const Sample& a, const Sample& b) { return a.total > b.total; });
+	samples.resize(count);
+	return samples;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+/// <summary>
+/// RequestProfile measures the time a request spends in each stage of its handler.
+/// mark() adds the time elapsed since the previous mark to a stage, one clock read per
+/// stage. The profile follows the request from the I/O thread to the executor and is
+/// recorded in a ring buffer of the thread that completes it: only the last requests of
+/// each thread are kept and nothing is shared between threads on the request path.
+/// </summary>
+class RequestProfile
+{
+public:
+	enum Stage
+	{
+		Limiter,		// rate limiter
+		Queue,			// waiting for an executor thread
+		Database,		// SQLite queries
+		Serialization,	// JSON parsing and building
+		Span,			// tracer and span
+		StageCount
+	};
+
+	struct Sample
+	{
+		const char*											route = nullptr;
+		int													code = 0;
+		std::chrono::steady_clock::time_point				finished;
+		std::chrono::nanoseconds							total{ 0 };
+		std::array<std::chrono::nanoseconds, StageCount>	stages{};	// the rest of total was spent in the handler itself
+	};
+
+	explicit RequestProfile(const char* route);
+
+	void mark(Stage stage);
+	void record(int code);
+
+	static const char* get_stage_name(Stage stage);
+	// Get the slowest of the requests kept by all the threads, the slowest first
+	static std::vector<Sample> get_slowest(size_t count);
+
+private:
+	Sample									sample_;
+	std::chrono::steady_clock::time_point	start_;
+	std::chrono::steady_clock::time_point	last_;
+};
+
+#endif
\ No newline at end of file
@@ -1,19 +1,241 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <charconv>
+#include <cstring>
+#include <memory_resource>
 #include "Routes.h"
+#include "Arena.h"
+#include "MealJson.h"
+#include "Snapshot.h"
+#include "PeriodicTask.h"
+#include "Idempotency.h"
+#include "Profiler.h"
 #include "utility.h"
 #include "traceservice.h"
 
 // Database filename
 static const std::string filename_db = "database.db3";
 
+// Online backups: taken every hour and on POST /admin/snapshot, the newest ones are kept
+static const std::string snapshot_folder = "snapshots";
+static const std::chrono::seconds snapshot_interval(3600);
+static const size_t snapshot_retention = 5;
+
+// The meal statistics are kept by counters, compared with the tables every 10 minutes
+static const std::chrono::seconds stats_check_interval(600);
+
+// Number of requests returned by /debug/slow when no count is given
+static const size_t slow_requests_count = 10;
+
+// Responses of POST /meals kept for the retries carrying the same Idempotency-Key
+static const size_t idempotency_capacity = 10000;
+static const std::chrono::seconds idempotency_ttl(24 * 3600);
+static const size_t max_idempotency_key_length = 255;
+static const std::string idempotency_file = "idempotency.db3";
+
+// Executors running the database work: reads and writes have their own queue so
+// that slow writes do not starve the reads. SQLite has a single writer per file,
+// each shard has its own writer thread and queue: a busy shard does not hold up the others.
+static const size_t reader_queue_capacity = 1024;
+static const size_t writer_queue_capacity = 256;
+
+// Bytes reserved per meal when a listing is serialized
+static const size_t meal_json_bytes = 80;
+
+/// <summary>
+/// Read the price of a meal from a JSON value, either a string ("12.45") or a number (12.45)
+/// </summary>
+/// <param name="value">the JSON value</param>
+/// <param name="price_cents">the price in cents</param>
+/// <returns>false if the value is not a valid price</returns>
+static bool read_price(const crow::json::rvalue& value, int64_t& price_cents)
+{
+	if (value.t() == crow::json::type::String)
+	{
+		return Utility::parse_price(std::string(value.s()), price_cents);
+	}
+	if (value.t() == crow::json::type::Number)
+	{
+		double price = value.d();
+		if (price < 0 || price * 100 >= static_cast<double>(INT64_MAX))
+		{
+			return false;
+		}
+		// same rule as the strings: at most 2 decimals, the tolerance only absorbs the binary rounding of price * 100
+		double cents = price * 100;
+		if (std::fabs(cents - std::round(cents)) > std::max(1e-6, cents * 1e-12))
+		{
+			return false;
+		}
+		price_cents = std::llround(cents);
+		return true;
+	}
+	return false;
+}
+
+/// <summary>
+/// Read the meal sent in the body of POST /meals
+/// </summary>
+/// <param name="body">the JSON body</param>
+/// <param name="meal">the meal read</param>
+/// <param name="error">the response to send when the meal is not valid</param>
+/// <returns>false if the meal is not valid</returns>
+static bool read_meal(const std::string& body, DBMeal& meal, crow::response& error)
+{
+	try
+	{
+		// load the body to a crwo::json::rvalue object
+		// check if the JSON object is valid raise an exception if it is not
+		auto json_body = crow::json::load(body);
+		if (!json_body) {
+			error = crow::response(400, "Invalid JSON");
+			return false;
+		}
+		// set the name, quantity, and price of the meal from the JSON object
+		meal.set_name(json_body["name"].s());
+		meal.set_quantity(json_body["quantity"].i());
+		int64_t price_cents = 0;
+		if (!read_price(json_body["price"], price_cents)) {
+			error = crow::response(400, "Invalid price");
+			return false;
+		}
+		meal.set_price_cents(price_cents);
+		return true;
+	}
+	catch (const std::exception& exception)
+	{
+		crow::json::wvalue error_json;
+		error_json["message"] = exception.what();
+		error = crow::response(500, error_json);
+		return false;
+	}
+}
+
+/// <summary>
+/// Build a JSON response from a serialized body
+/// the body is moved into the response, the bytes sent are the ones written by the serialization
+/// </summary>
+static crow::response json_response(int code, std::string&& body)
+{
+	crow::response response(code, std::move(body));
+	response.set_header("Content-Type", "application/json");
+	return response;
+}
+
+/// <summary>
+/// Number of database files the meals are spread over, set RESTAPI_SHARDS to use more than one
+/// </summary>
+static size_t shard_count()
+{
+	const char* shards = std::getenv("RESTAPI_SHARDS");
+	return shards ? static_cast<size_t>(std::max(1, std::atoi(shards))) : 1;
+}
+
+/// <summary>
+/// Copy a response built by a handler into the response of the connection and send it
+/// </summary>
+/// <param name="res">the response of the connection</param>
+/// <param name="result">the response built by the handler</param>
+static void complete(crow::response& res, crow::response result)
+{
+	res.code = result.code;
+	res.body = std::move(result.body);
+	res.headers = std::move(result.headers);
+	res.end();
+}
+
+/// <summary>
+/// Keep what is needed to send a response again for an Idempotency-Key
+/// </summary>
+static IdempotencyStore::Response stored_response(crow::response& response)
+{
+	IdempotencyStore::Response stored;
+	stored.code = response.code;
+	stored.content_type = response.get_header_value("Content-Type");
+	stored.body = response.body;
+	return stored;
+}
+
+/// <summary>
+/// Build the response sent again for an Idempotency-Key
+/// </summary>
+static crow::response replay_response(const IdempotencyStore::Response& stored)
+{
+	crow::response response(stored.code, stored.body);
+	if (!stored.content_type.empty())
+	{
+		response.set_header("Content-Type", stored.content_type);
+	}
+	response.set_header("Idempotent-Replayed", "true");
+	return response;
+}
+
 // Constructor
-Routes::Routes(crow::SimpleApp& app) : m_App(app)
+Routes::Routes(crow::SimpleApp& app) : m_App(app),
+	readers_(std::max(2u, std::thread::hardware_concurrency()), reader_queue_capacity)
 
 {
+	for (size_t i = 0; i < shard_count(); i++)
+	{
+		writers_.push_back(std::make_unique<Executor>(1, writer_queue_capacity));
+	}
+
+	// set RESTAPI_RESTORE_SNAPSHOT to start from the newest snapshot instead of the current database
+	std::string file_name = Utility::get_temporary_folder(filename_db);
+	if (std::getenv("RESTAPI_RESTORE_SNAPSHOT"))
+	{
+		SnapshotScheduler::restore_latest(Utility::get_temporary_folder(snapshot_folder), fs::path(file_name).parent_path().string());
+	}
+
 	// use the function deletedatabase to delete the database file if you want to start with a clean database
-	db_ = std::make_unique<DBSQLite>(Utility::get_temporary_folder(filename_db));
+	db_ = std::make_unique<DBSQLite>(file_name, shard_count());
+	snapshots_ = std::make_unique<SnapshotScheduler>(*db_, Utility::get_temporary_folder(snapshot_folder), snapshot_interval, snapshot_retention);
+	// set RESTAPI_IDEMPOTENCY_PERSIST to keep the responses of the Idempotency-Key across restarts
+	idempotency_ = std::make_unique<IdempotencyStore>(idempotency_capacity, idempotency_ttl,
+		std::getenv("RESTAPI_IDEMPOTENCY_PERSIST") ? Utility::get_temporary_folder(idempotency_file) : "");
+	stats_check_ = std::make_unique<PeriodicTask>(stats_check_interval, [this] { db_->verify_stats(); });
 };
 
+/// <summary>
+/// Run the work of a handler on an executor and send its response from there.
+/// the Crow I/O thread returns as soon as the work is queued, a full queue is answered with 503
+/// </summary>
+/// <param name="executor">the reader pool or the writer of a shard</param>
+/// <param name="res">the response of the connection</param>
+/// <param name="profile">the stages timed on the I/O thread, recorded with the response</param>
+/// <param name="work">the work, returns the response to send</param>
+/// <returns>false if the queue was full</returns>
+bool Routes::dispatch(Executor& executor, crow::response& res, RequestProfile profile, std::function<crow::response(RequestProfile&)> work)
+{
+	bool queued = executor.submit([&res, profile, work = std::move(work)]() mutable
+		{
+			profile.mark(RequestProfile::Queue);
+			crow::response result;
+			try
+			{
+				result = work(profile);
+			}
+			catch (const std::exception& error)
+			{
+				crow::json::wvalue error_json;
+				error_json["message"] = error.what();
+				result = crow::response(500, error_json);
+			}
+			profile.record(result.code);
+			complete(res, std::move(result));
+		});
+	if (!queued)
+	{
+		// the queue depth tells the client how far behind the server is
+		crow::json::wvalue busy;
+		busy["message"] = "Server busy";
+		busy["queued"] = executor.pending();
+		complete(res, crow::response(503, busy));
+	}
+	return queued;
+}
+
 void Routes::orders_routes()
 {
 	/**
@@ -24,55 +246,114 @@ void Routes::orders_routes()
 	 */
 	CROW_ROUTE(m_App, "/meals")
 		.methods(crow::HTTPMethod::POST)
-		([this](const crow::request& req)
+		([this](const crow::request& req, crow::response& res)
 			{
+				// time spent in each stage, /debug/slow shows the slowest requests
+				RequestProfile profile("POST /meals");
 				// Get the a tracer instance from OpenTelemetry::trace::Provider
 				// Name the tracer "rest-tracer"               
 				auto tracer = opentelemetry::trace::Provider::GetTracerProvider()->GetTracer("rest-tracer");
 
 				// create a new span for the POST request
 				auto span = tracer->StartSpan("POST /meal");
+				profile.mark(RequestProfile::Span);
 
 				// start a timer to measure the duration of the request using std::chrono:steady_clock
 				auto start = std::chrono::steady_clock::now();
 
 				crow::json::wvalue output;
-				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
-				try
+				if (!rateLimiter[req.url].allow_request()) return complete(res, crow::response(429));
+				profile.mark(RequestProfile::Limiter);
+
+				// a retry carrying the Idempotency-Key of a request already done gets the stored response
+				// without touching the database, the key is bound to the body of the first request
+				std::string key = req.get_header_value("Idempotency-Key");
+				uint64_t fingerprint = Utility::fnv1a(req.body);
+				if (!key.empty())
 				{
-					// load req.body to a crwo::json::rvalue object
-					// check if the JSON object is valid raise an exception if it is not
-					auto json_body = crow::json::load(req.body);
-					if (!json_body) {
-						return crow::response(400, "Invalid JSON");
+					if (key.size() > max_idempotency_key_length) return complete(res, crow::response(400, "Invalid Idempotency-Key"));
+
+					IdempotencyStore::Response stored;
+					switch (idempotency_->begin(key, fingerprint, stored))
+					{
+					case IdempotencyStore::Claim::Replay:
+						return complete(res, replay_response(stored));
+					case IdempotencyStore::Claim::InProgress:
+						return complete(res, crow::response(409, "A request with this Idempotency-Key is in progress"));
+					case IdempotencyStore::Claim::Mismatch:
+						return complete(res, crow::response(422, "Idempotency-Key already used with another request"));
+					case IdempotencyStore::Claim::Started:
+						break;
 					}
-					// create a new DBMeal object
-					// set the name, quantity, and price of the meal from the JSON object
-					DBMeal meal;
-					meal.set_name(json_body["name"].s());
-					meal.set_quantity(json_body["quantity"].i());
-					meal.set_price(json_body["price"].s());
-					// add the meal to the database                  
-					db_->create_new_meal(meal);
-					// end the timer, calculate the elapse time between start and end 
-					// convert the duration to milliseconds
-					auto end = std::chrono::steady_clock::now();
-					auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-					// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
-					span->SetAttribute("elapse", std::to_string(duration.count()));
-					// end the span
-					span->End();
-
-					return crow::response(200);
 				}
-				catch (const std::exception& error)
+
+				// remember the response for the retries, a server error lets the retry run again
+				auto remember = [this, key, fingerprint](crow::response& response)
+					{
+						if (!key.empty() && response.code >= 500)
+						{
+							idempotency_->abandon(key);
+						}
+						else if (!key.empty())
+						{
+							idempotency_->complete(key, fingerprint, stored_response(response));
+						}
+					};
+
+				// the body is read on the I/O thread: the name of the meal picks its shard and so its writer
+				DBMeal meal;
+				crow::response invalid;
+				bool valid = read_meal(req.body, meal, invalid);
+				profile.mark(RequestProfile::Serialization);
+				if (!valid)
+				{
+					remember(invalid);
+					return complete(res, std::move(invalid));
+				}
+				Executor& writer = *writers_[db_->shard_for_name(meal.get_name())];
+
+				// the database work runs on the writer of the shard, the I/O thread goes back to the other connections
+				bool queued = dispatch(writer, res, profile, [this, span, start, meal = std::move(meal), remember](RequestProfile& profile) -> crow::response
 				{
-					// return a JSON object with the error message explaining the error
-					// Extract the error message from the exception and send it back in the response body
-					// return a 500 status code
-					crow::json::wvalue error_json;
-					error_json["message"] = error.what();
-					return crow::response(500, error_json);
+					crow::response response = [&]() -> crow::response
+					{
+						try
+						{
+							// add the meal to the database, the response carries its id
+							int64_t id = db_->create_new_meal(meal);
+							profile.mark(RequestProfile::Database);
+							crow::json::wvalue output;
+							output["id"] = id;
+							// end the timer, calculate the elapse time between start and end 
+							// convert the duration to milliseconds
+							auto end = std::chrono::steady_clock::now();
+							auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+							// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
+							span->SetAttribute("elapse", std::to_string(duration.count()));
+							// end the span
+							span->End();
+							profile.mark(RequestProfile::Span);
+
+							return crow::response(200, output);
+						}
+						catch (const std::exception& error)
+						{
+							// return a JSON object with the error message explaining the error
+							// Extract the error message from the exception and send it back in the response body
+							// return a 500 status code
+							crow::json::wvalue error_json;
+							error_json["message"] = error.what();
+							return crow::response(500, error_json);
+						}
+				}();
+
+					remember(response);
+					return response;
+				});
+				// nothing ran, the key can be used again
+				if (!queued && !key.empty())
+				{
+					idempotency_->abandon(key);
 				}
 			}
 			);
@@ -84,60 +365,147 @@ void Routes::orders_routes()
 	 */
 	CROW_ROUTE(m_App, "/meals")
 		.methods(crow::HTTPMethod::GET)
-		([this](const crow::request& req)
+		([this](const crow::request& req, crow::response& res)
 			{
+				// time spent in each stage, /debug/slow shows the slowest requests
+				RequestProfile profile("GET /meals");
 				// Get the a tracer instance from OpenTelemetry::trace::Provider
 				// Name the tracer "rest-tracer"    
 				auto tracer = opentelemetry::trace::Provider::GetTracerProvider()->GetTracer("rest-tracer");
 				// create a new span for the POST request
 				auto span = tracer->StartSpan("GET /meal");
+				profile.mark(RequestProfile::Span);
 				// start a timer to measure the duration of the request using std::chrono:steady_clock
 				auto start = std::chrono::steady_clock::now();
 				crow::json::wvalue output;
-				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
+				if (!rateLimiter[req.url].allow_request()) return complete(res, crow::response(429));
+				profile.mark(RequestProfile::Limiter);
 
-				try
+				// the database work runs on the reader pool, the I/O thread goes back to the other connections
+				dispatch(readers_, res, profile, [this, span, start, url_params = req.url_params](RequestProfile& profile) -> crow::response
 				{
-					// get all meals from the database
-					// send back the list of meals in the response body using array of JSON objects
-					std::list<DBMeal> meals = db_->get_all_meals();
-					std::vector<crow::json::wvalue> crew_members;
+					// the rows and the body are built in the arena of the thread, released when the handler returns
+					ArenaScope arena;
 
-					// loop through the list of meals and add each meal to a std::vector<crow::json::wvalue>
-					for (auto& meal : meals)
+					try
 					{
-						crow::json::wvalue meal_json;
-						meal_json["name"] = meal.get_name();
-						meal_json["quantity"] = meal.get_quantity();
-						meal_json["price"] = meal.get_price();
-						crew_members.push_back(meal_json);
+						// optional price range and ordering: ?min_price=10&max_price=15.5&sort=price
+						// any of them switches to the query served by the price index
+						const char* min_price = url_params.get("min_price");
+						const char* max_price = url_params.get("max_price");
+						const char* sort = url_params.get("sort");
+
+						int64_t min_price_cents = 0;
+						int64_t max_price_cents = INT64_MAX;
+						if (min_price && !Utility::parse_price(min_price, min_price_cents)) {
+							return crow::response(400, "Invalid min_price");
+						}
+						if (max_price && !Utility::parse_price(max_price, max_price_cents)) {
+							return crow::response(400, "Invalid max_price");
+						}
+						if (sort && std::string_view(sort) != "price") {
+							return crow::response(400, "Invalid sort");
+						}
+
+						// get all meals from the database
+						// send back the list of meals in the response body using array of JSON objects
+						DBMealSet meals = (min_price || max_price || sort) ?
+							db_->get_meals_by_price(min_price_cents, max_price_cents, sort != nullptr, arena.resource()) :
+							db_->get_all_meals(arena.resource());
+						profile.mark(RequestProfile::Database);
+						// serialize the set of meals as a JSON array in the arena, then copy it once in the response:
+						// the appends to a std::pmr::string are inlined, those to a std::string are calls into the
+						// standard library and cost more than the copy (see serialization_bench.cpp)
+						std::pmr::string body(arena.resource());
+						body.reserve(meals.size() * meal_json_bytes + 2);
+						body += '[';
+						for (size_t i = 0; i < meals.size(); i++)
+						{
+							if (i != 0)
+							{
+								body += ',';
+							}
+							append_meal_json(body, meals[i].id, meals.get_name(meals[i]), meals[i].quantity, meals[i].has_price, meals[i].price_cents);
+						}
+						body += ']';
+						profile.mark(RequestProfile::Serialization);
+
+						// return the array of meals in the response body
+						// return a 200 status code
+
+						// end the timer, calculate the elapse time between start and end 
+						 // convert the duration to milliseconds
+						auto end = std::chrono::steady_clock::now();
+						auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+						// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
+						span->SetAttribute("elapse", std::to_string(duration.count()));
+						// end the span
+						span->End();
+						profile.mark(RequestProfile::Span);
+						return json_response(200, std::string(body));
 					}
+					catch (const std::exception& error)
+					{
+						// return a JSON object with the error message explaining the error
+						// Extract the error message from the exception and send it back in the response body
+						// return a 500 status code
+						crow::json::wvalue error_json;
+						error_json["message"] = error.what();
+						return crow::response(500, error_json);
+					}
+				});
+			}
+			);
+
+	/**
+	 * Handles the GET request for the statistics of the catalog.
+	 * registered before "/meals/<string>" so that Crow prefers it for "/meals/stats".
+	 * The aggregates come from counters kept by the database, no table is read.
+	 *
+	 * @param req The crow::request object.
+	 * @return The crow::response with the count, the stock and the price distribution.
+	 */
+	CROW_ROUTE(m_App, "/meals/stats")
+		.methods(crow::HTTPMethod::GET)
+		([this](const crow::request& req)
+			{
+				// time spent in each stage, /debug/slow shows the slowest requests
+				RequestProfile profile("GET /meals/stats");
+				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
+				profile.mark(RequestProfile::Limiter);
 
-					// return the vector of meals in the response body
-					// return a 200 status code
-
-					crow::json::wvalue wv;
-					wv = std::move(crew_members);
-
-					// end the timer, calculate the elapse time between start and end 
-					 // convert the duration to milliseconds
-					auto end = std::chrono::steady_clock::now();
-					auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-					// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
-					span->SetAttribute("elapse", std::to_string(duration.count()));
-					// end the span
-					span->End();
-					return crow::response(200, std::move(wv));
+				MealStats::Totals totals = db_->get_stats();
+				profile.mark(RequestProfile::Database);
+				crow::json::wvalue output;
+				output["count"] = totals.count;
+				output["total_quantity"] = totals.total_quantity;
+				// meals whose legacy price could not be converted, not part of the other figures
+				output["unpriced"] = totals.unpriced;
+				if (totals.count != 0)
+				{
+					output["min_price"] = Utility::format_price(totals.min_price_cents);
+					output["max_price"] = Utility::format_price(totals.max_price_cents);
+					output["average_price"] = Utility::format_price(totals.total_price_cents / static_cast<int64_t>(totals.count));
 				}
-				catch (const std::exception& error)
+
+				// number of meals per price range, the last range has no upper bound
+				std::vector<crow::json::wvalue> ranges;
+				for (size_t i = 0; i < totals.price_ranges.size(); i++)
 				{
-					// return a JSON object with the error message explaining the error
-					// Extract the error message from the exception and send it back in the response body
-					// return a 500 status code
-					crow::json::wvalue error_json;
-					error_json["message"] = error.what();
-					return crow::response(500, error_json);
+					crow::json::wvalue range;
+					range["min_price"] = Utility::format_price(i == 0 ? 0 : MealStats::price_bounds[i - 1]);
+					if (i < MealStats::price_bounds.size())
+					{
+						range["max_price"] = Utility::format_price(MealStats::price_bounds[i]);
+					}
+					range["count"] = totals.price_ranges[i];
+					ranges.push_back(std::move(range));
 				}
+				output["price_distribution"] = std::move(ranges);
+				crow::response response(200, output);
+				profile.mark(RequestProfile::Serialization);
+				profile.record(response.code);
+				return response;
 			}
 			);
 
@@ -150,47 +518,58 @@ void Routes::orders_routes()
 	 */
 	CROW_ROUTE(m_App, "/meals/<int>")
 		.methods(crow::HTTPMethod::GET)
-		([this](const crow::request& req, int meal_id)
+		([this](const crow::request& req, crow::response& res, int64_t meal_id)
 			{
+				// time spent in each stage, /debug/slow shows the slowest requests
+				RequestProfile profile("GET /meals/<int>");
 				// Get the a tracer instance from OpenTelemetry::trace::Provider
 				// Name the tracer "rest-tracer"
 				auto tracer = opentelemetry::trace::Provider::GetTracerProvider()->GetTracer("rest-tracer");
 				// create a new span for the POST request
 				auto span = tracer->StartSpan("GET /meal/<int>");
+				profile.mark(RequestProfile::Span);
 				// start a timer to measure the duration of the request using std::chrono:steady_clock                
 				auto start = std::chrono::steady_clock::now();
 
 				crow::json::wvalue output;
-				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
-				try
-				{
-					// get the meal by id from the database
-					// send back the meal in the response body using JSON object
-					DBMeal meal = db_->get_meal_by_id(meal_id);
-					crow::json::wvalue meal_json;
-					meal_json["name"] = meal.get_name();
-					meal_json["quantity"] = meal.get_quantity();
-					meal_json["price"] = meal.get_price();
-
-					// end the timer, calculate the elapse time between start and end 
-					// convert the duration to milliseconds
-					auto end = std::chrono::steady_clock::now();
-					auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-					// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
-					span->SetAttribute("elapse", std::to_string(duration.count()));
-					// end the span
-					span->End();
-					return crow::response(200, meal_json);
-				}
-				catch (const std::exception& error)
+				if (!rateLimiter[req.url].allow_request()) return complete(res, crow::response(429));
+				profile.mark(RequestProfile::Limiter);
+
+				// the database work runs on the reader pool, the I/O thread goes back to the other connections
+				dispatch(readers_, res, profile, [this, span, start, meal_id](RequestProfile& profile) -> crow::response
 				{
-					// return a JSON object with the error message explaining the error
-					// Extract the error message from the exception and send it back in the response body
-					// return a 500 status code
-					crow::json::wvalue error_json;
-					error_json["message"] = error.what();
-					return crow::response(500, error_json);
-				}
+					try
+					{
+						// get the meal by id from the database
+						// send back the meal in the response body using JSON object
+						DBMeal meal = db_->get_meal_by_id(meal_id);
+						profile.mark(RequestProfile::Database);
+						std::string body;
+						body.reserve(meal_json_bytes);
+						append_meal_json(body, meal.get_id(), meal.get_name(), meal.get_quantity(), meal.has_price(), meal.get_price_cents());
+						profile.mark(RequestProfile::Serialization);
+
+						// end the timer, calculate the elapse time between start and end 
+						// convert the duration to milliseconds
+						auto end = std::chrono::steady_clock::now();
+						auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+						// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
+						span->SetAttribute("elapse", std::to_string(duration.count()));
+						// end the span
+						span->End();
+						profile.mark(RequestProfile::Span);
+						return json_response(200, std::move(body));
+					}
+					catch (const std::exception& error)
+					{
+						// return a JSON object with the error message explaining the error
+						// Extract the error message from the exception and send it back in the response body
+						// return a 500 status code
+						crow::json::wvalue error_json;
+						error_json["message"] = error.what();
+						return crow::response(500, error_json);
+					}
+				});
 			}
 			);
 	/**
@@ -202,53 +581,61 @@ void Routes::orders_routes()
 	 */
 	CROW_ROUTE(m_App, "/meals/<string>")
 		.methods(crow::HTTPMethod::GET)
-		([this](const crow::request& req, std::string meal_name)
+		([this](const crow::request& req, crow::response& res, std::string meal_name)
 			{
+				// time spent in each stage, /debug/slow shows the slowest requests
+				RequestProfile profile("GET /meals/<string>");
 				// Get the a tracer instance from OpenTelemetry::trace::Provider
 				// Name the tracer "rest-tracer"
 				auto tracer = opentelemetry::trace::Provider::GetTracerProvider()->GetTracer("rest-tracer");
 				// create a new span for the POST request
 				auto span = tracer->StartSpan("GET /meal/<string>");
+				profile.mark(RequestProfile::Span);
 				// start a timer to measure the duration of the request using std::chrono:steady_clock                
 				auto start = std::chrono::steady_clock::now();
 
 				crow::json::wvalue output;
-				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
-				try
+				if (!rateLimiter[req.url].allow_request()) return complete(res, crow::response(429));
+				profile.mark(RequestProfile::Limiter);
+
+				// Unescape the meal name, a malformed escape is rejected before any database work
+				if (!Utility::UnescapePostData(meal_name)) return complete(res, crow::response(400, "Invalid meal name"));
+
+				// the database work runs on the reader pool, the I/O thread goes back to the other connections
+				dispatch(readers_, res, profile, [this, span, start, meal_name = std::move(meal_name)](RequestProfile& profile) -> crow::response
 				{
-					// Unescape the meal name
-					Utility::UnescapePostData(meal_name);
-
-					// get the meal by name from the database
-					// send back the meal in the response body using JSON object
-					crow::json::wvalue output;
-					if (!rateLimiter[req.url].allow_request()) return crow::response(429);
-					// get the meal by name from the database
-					// send back the meal in the response body using JSON object
-					DBMeal meal = db_->get_meal_by_name(meal_name);
-					output["name"] = meal.get_name();
-					output["quantity"] = meal.get_quantity();
-					output["price"] = meal.get_price();
+					try
+					{
+						// get the meal by name from the database
+						// send back the meal in the response body using JSON object
+						DBMeal meal = db_->get_meal_by_name(meal_name);
+						profile.mark(RequestProfile::Database);
+						std::string body;
+						body.reserve(meal_json_bytes);
+						append_meal_json(body, meal.get_id(), meal.get_name(), meal.get_quantity(), meal.has_price(), meal.get_price_cents());
+						profile.mark(RequestProfile::Serialization);
 					
-					// end the timer, calculate the elapse time between start and end 
-					// convert the duration to milliseconds
-					auto end = std::chrono::steady_clock::now();
-					auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-					// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
-					span->SetAttribute("elapse", std::to_string(duration.count()));
-					// end the span
-					span->End();
-					return crow::response(200, output);
-				}
-				catch (const std::exception& error)
-				{
-					// return a JSON object with the error message explaining the error
-					// Extract the error message from the exception and send it back in the response body
-					// return a 500 status code
-					crow::json::wvalue error_json;
-					error_json["error"] = error.what();
-					return crow::response(500, error_json);
-				}
+						// end the timer, calculate the elapse time between start and end 
+						// convert the duration to milliseconds
+						auto end = std::chrono::steady_clock::now();
+						auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+						// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
+						span->SetAttribute("elapse", std::to_string(duration.count()));
+						// end the span
+						span->End();
+						profile.mark(RequestProfile::Span);
+						return json_response(200, std::move(body));
+					}
+					catch (const std::exception& error)
+					{
+						// return a JSON object with the error message explaining the error
+						// Extract the error message from the exception and send it back in the response body
+						// return a 500 status code
+						crow::json::wvalue error_json;
+						error_json["error"] = error.what();
+						return crow::response(500, error_json);
+					}
+				});
 			}
 			);
 
@@ -261,46 +648,172 @@ void Routes::orders_routes()
 	 */
 	CROW_ROUTE(m_App, "/meals/<int>")
 		.methods(crow::HTTPMethod::Delete)
-		([this](const crow::request& req, int meal_id)
+		([this](const crow::request& req, crow::response& res, int64_t meal_id)
 			{
+				// time spent in each stage, /debug/slow shows the slowest requests
+				RequestProfile profile("DELETE /meals/<int>");
 				// Get the a tracer instance from OpenTelemetry::trace::Provider
 				// Name the tracer "rest-tracer"
 				auto tracer = opentelemetry::trace::Provider::GetTracerProvider()->GetTracer("rest-tracer");
 				// create a new span for the POST request
 				auto span = tracer->StartSpan("Delete /meal/<int>");
+				profile.mark(RequestProfile::Span);
 				// start a timer to measure the duration of the request using std::chrono:steady_clock                
 				auto start = std::chrono::steady_clock::now();
 
 				crow::json::wvalue output;
-				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
-				try
+				if (!rateLimiter[req.url].allow_request()) return complete(res, crow::response(429));
+				profile.mark(RequestProfile::Limiter);
+
+				// the database work runs on the writer of the shard holding the meal, the I/O thread goes back to the other connections
+				dispatch(*writers_[db_->shard_index_for_id(meal_id)], res, profile, [this, span, start, meal_id](RequestProfile& profile) -> crow::response
 				{
-					// delete the meal by id from the database
-					// get a db_
-					// return a 200 status code
-					int status = db_->delete_mail_by_id(meal_id);
-					crow::json::wvalue error_status;
-					error_status["status"] = status;
-					// end the timer, calculate the elapse time between start and end 
-					// convert the duration to milliseconds
-					auto end = std::chrono::steady_clock::now();
-					auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-					// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
-					span->SetAttribute("elapse", std::to_string(duration.count()));
-					// end the span
-					span->End();
-					return crow::response(status, error_status);
+					try
+					{
+						// delete the meal by id from the database
+						// get a db_
+						// return a 200 status code
+						int status = db_->delete_mail_by_id(meal_id);
+						profile.mark(RequestProfile::Database);
+						crow::json::wvalue error_status;
+						error_status["status"] = status;
+						profile.mark(RequestProfile::Serialization);
+						// end the timer, calculate the elapse time between start and end 
+						// convert the duration to milliseconds
+						auto end = std::chrono::steady_clock::now();
+						auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+						// using the span, create a new attribute named elapse, set the duration of the request in milliseconds, convert the duration a std::string				
+						span->SetAttribute("elapse", std::to_string(duration.count()));
+						// end the span
+						span->End();
+						profile.mark(RequestProfile::Span);
+						return crow::response(status, error_status);
 
+					}
+					catch (const std::exception& error)
+					{
+						// return a JSON object with the error message explaining the error
+						// Extract the error message from the exception and send it back in the response body
+						// return a 500 status code
+						crow::json::wvalue error_json;
+						error_json["error"] = error.what();
+						return crow::response(500, error_json);
+					}
+				});
+			}
+			);
+	/**
+	 * Handles the GET request for the statistics of the request arenas.
+	 *
+	 * @param req The crow::request object.
+	 * @return The crow::response with the statistics.
+	 */
+	CROW_ROUTE(m_App, "/debug/arena")
+		.methods(crow::HTTPMethod::GET)
+		([](const crow::request& req)
+			{
+				RequestArena::Statistics statistics = RequestArena::get_statistics();
+				crow::json::wvalue output;
+				output["threads"] = statistics.threads;
+				output["requests"] = statistics.requests;
+				output["bytes_allocated"] = statistics.bytes_allocated;
+				output["peak_request_bytes"] = statistics.peak_request_bytes;
+				output["allocations"] = statistics.allocations;
+				output["upstream_allocations"] = statistics.upstream_allocations;
+				return crow::response(200, output);
+			}
+			);
+	/**
+	 * Handles the GET request for the slowest recent requests and the time they spent in each stage.
+	 * ?count=N sets the number of requests, 10 by default.
+	 *
+	 * @param req The crow::request object.
+	 * @return The crow::response with the requests, the slowest first.
+	 */
+	CROW_ROUTE(m_App, "/debug/slow")
+		.methods(crow::HTTPMethod::GET)
+		([](const crow::request& req)
+			{
+				size_t count = slow_requests_count;
+				if (const char* value = req.url_params.get("count"))
+				{
+					auto parsed = std::from_chars(value, value + std::strlen(value), count);
+					if (parsed.ec != std::errc() || *parsed.ptr != '\0' || count == 0) {
+						return crow::response(400, "Invalid count");
+					}
 				}
-				catch (const std::exception& error)
+
+				auto now = std::chrono::steady_clock::now();
+				std::vector<crow::json::wvalue> requests;
+				for (const RequestProfile::Sample& sample : RequestProfile::get_slowest(count))
 				{
-					// return a JSON object with the error message explaining the error
-					// Extract the error message from the exception and send it back in the response body
-					// return a 500 status code
-					crow::json::wvalue error_json;
-					error_json["error"] = error.what();
-					return crow::response(500, error_json);
+					crow::json::wvalue request;
+					request["route"] = sample.route;
+					request["code"] = sample.code;
+					request["age_ms"] = std::chrono::duration_cast<std::chrono::milliseconds>(now - sample.finished).count();
+					request["total_us"] = std::chrono::duration_cast<std::chrono::microseconds>(sample.total).count();
+					// what is not in a stage was spent in the handler itself
+					auto other = sample.total;
+					for (int stage = 0; stage < RequestProfile::StageCount; stage++)
+					{
+						request["stages_us"][RequestProfile::get_stage_name(static_cast<RequestProfile::Stage>(stage))] =
+							std::chrono::duration_cast<std::chrono::microseconds>(sample.stages[stage]).count();
+						other -= sample.stages[stage];
+					}
+					request["stages_us"]["other"] = std::chrono::duration_cast<std::chrono::microseconds>(other).count();
+					requests.push_back(std::move(request));
 				}
+				crow::json::wvalue output;
+				output["requests"] = std::move(requests);
+				return crow::response(200, output);
+			}
+			);
+	/**
+	 * Handles the POST request starting a snapshot of the database.
+	 *
+	 * @param req The crow::request object.
+	 * @return 202 when the snapshot is started, 409 when one is already in progress.
+	 */
+	CROW_ROUTE(m_App, "/admin/snapshot")
+		.methods(crow::HTTPMethod::POST)
+		([this](const crow::request& req)
+			{
+				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
+
+				crow::json::wvalue output;
+				if (!snapshots_->request_snapshot())
+				{
+					output["message"] = "Snapshot already in progress";
+					return crow::response(409, output);
+				}
+				output["message"] = "Snapshot started";
+				return crow::response(202, output);
+			}
+			);
+
+	/**
+	 * Handles the GET request for the state of the snapshots.
+	 *
+	 * @param req The crow::request object.
+	 * @return The crow::response with the state of the last snapshot.
+	 */
+	CROW_ROUTE(m_App, "/admin/snapshot")
+		.methods(crow::HTTPMethod::GET)
+		([this](const crow::request& req)
+			{
+				if (!rateLimiter[req.url].allow_request()) return crow::response(429);
+
+				SnapshotScheduler::Status status = snapshots_->get_status();
+				crow::json::wvalue output;
+				output["running"] = status.running;
+				output["snapshots"] = status.snapshots;
+				output["last_snapshot"] = status.last_snapshot;
+				output["last_error"] = status.last_error;
+				output["last_duration_ms"] = status.last_duration.count();
+				output["pages_per_step"] = status.pacing.pages_per_step;
+				output["steps"] = status.pacing.steps;
+				output["longest_step_us"] = status.pacing.longest_step.count();
+				return crow::response(200, output);
 			}
 			);
 }
\ No newline at end of file
@@ -2,9 +2,15 @@
 #define ROUTES_H
 
 #include <crow.h>
+#include <functional>
 
 #include "Limiter.h"
 #include "DataBase.h"
+#include "Executor.h"
+#include "Snapshot.h"
+#include "PeriodicTask.h"
+#include "Idempotency.h"
+#include "Profiler.h"
 
 
 class Routes
@@ -14,10 +20,19 @@ public:
 	void orders_routes();
 
 private:
+	bool dispatch(Executor& executor, crow::response& res, RequestProfile profile, std::function<crow::response(RequestProfile&)> work);
+
 	std::unordered_map<std::string, Limiter> rateLimiter;
 	crow::SimpleApp& m_App;
 
 	std::unique_ptr<DBSQLite> db_;
+	std::unique_ptr<SnapshotScheduler> snapshots_;
+	std::unique_ptr<PeriodicTask> stats_check_;
+	std::unique_ptr<IdempotencyStore> idempotency_;
+
+	// declared after db_ so that the pending work is done before the database is closed
+	Executor readers_;
+	std::vector<std::unique_ptr<Executor>> writers_;	// one single thread writer per shard
 };
 
 #endif
\ No newline at end of file
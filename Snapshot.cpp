@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <vector>
+#include "Snapshot.h"
+
+namespace fs = std::filesystem;
+
+// A snapshot is written in a "partial-" folder renamed "snapshot-" once complete
+static const std::string snapshot_prefix = "snapshot-";
+static const std::string partial_prefix = "partial-";
+
+/// <summary>
+/// Name of a new snapshot from the current UTC time, the names sort in time order
+/// </summary>
+static std::string snapshot_name()
+{
+	auto now = std::chrono::system_clock::now();
+	std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+	int milliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+
+	char date[32];
+	std::strftime(date, sizeof(date), "%Y%m%d-%H%M%S", std::gmtime(&seconds));
+	char name[64];
+	std::snprintf(name, sizeof(name), "%s%s-%03d", snapshot_prefix.c_str(), date, milliseconds);
+	return name;
+}
+
+/// <summary>
+/// List the folders of a snapshot folder starting with a prefix, from the oldest to the newest
+/// </summary>
+static std::vector<fs::path> list_folders(const std::string& folder, const std::string& prefix)
+{
+	std::vector<fs::path> folders;
+	if (!fs::exists(folder))
+	{
+		return folders;
+	}
+	for (const auto& entry : fs::directory_iterator(folder))
+	{
+		if (entry.is_directory() && entry.path().filename().string().rfind(prefix, 0) == 0)
+		{
+			folders.push_back(entry.path());
+		}
+	}
+	std::sort(folders.begin(), folders.end());
+	return folders;
+}
+
+/// <summary>
+/// Start the scheduler thread
+/// </summary>
+/// <param name="db">the database to copy</param>
+/// <param name="folder">the folder holding the snapshots</param>
+/// <param name="interval">time between two snapshots, 0 to only take them on request</param>
+/// <param name="retention">number of snapshots to keep</param>
+SnapshotScheduler::SnapshotScheduler(DBSQLite& db, const std::string& folder, std::chrono::seconds interval, size_t retention)
+	: db_(db), folder_(folder), interval_(interval), retention_(std::max<size_t>(1, retention))
+{
+	thread_ = std::thread(&SnapshotScheduler::run, this);
+}
+
+/// <summary>
+/// Stop the scheduler thread, a snapshot in progress is completed first
+/// </summary>
+SnapshotScheduler::~SnapshotScheduler()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wakeup_.notify_all();
+	thread_.join();
+}
+
+/// <summary>
+/// Ask for a snapshot now
+/// </summary>
+/// <returns>false if a snapshot is already requested or in progress</returns>
+bool SnapshotScheduler::request_snapshot()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (requested_ || status_.running)
+		{
+			return false;
+		}
+		requested_ = true;
+	}
+	wakeup_.notify_all();
+	return true;
+}
+
+/// <summary>
+/// Get the state of the scheduler and the measures of the last snapshot
+/// </summary>
+SnapshotScheduler::Status SnapshotScheduler::get_status()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	return status_;
+}
+
+void SnapshotScheduler::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_)
+	{
+		auto ready = [this] { return stopping_ || requested_; };
+		if (interval_.count() > 0)
+		{
+			wakeup_.wait_for(lock, interval_, ready);
+		}
+		else
+		{
+			wakeup_.wait(lock, ready);
+		}
+		if (stopping_)
+		{
+			break;
+		}
+
+		requested_ = false;
+		status_.running = true;
+		lock.unlock();
+		take_snapshot();
+		lock.lock();
+		status_.running = false;
+	}
+}
+
+/// <summary>
+/// Copy the database into a new snapshot folder then apply the retention policy
+/// </summary>
+void SnapshotScheduler::take_snapshot()
+{
+	auto start = std::chrono::steady_clock::now();
+	std::string name = snapshot_name();
+	fs::path partial = fs::path(folder_) / (partial_prefix + name);
+	fs::path target = fs::path(folder_) / name;
+
+	try
+	{
+		fs::create_directories(partial);
+		db_.backup_to(partial.string(), pacing_);
+		fs::rename(partial, target);
+		rotate();
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		status_.snapshots++;
+		status_.last_snapshot = target.string();
+		status_.last_error.clear();
+		status_.last_duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		status_.pacing = pacing_;
+	}
+	catch (const std::exception& error)
+	{
+		std::error_code ignored;
+		fs::remove_all(partial, ignored);
+
+		CROW_LOG_WARNING << "Snapshot " << name << " failed: " << error.what();
+		std::unique_lock<std::mutex> lock(mutex_);
+		status_.last_error = error.what();
+	}
+}
+
+/// <summary>
+/// Remove the oldest snapshots beyond the retention and the leftovers of interrupted snapshots
+/// </summary>
+void SnapshotScheduler::rotate()
+{
+	std::vector<fs::path> snapshots = list_folders(folder_, snapshot_prefix);
+	for (size_t i = 0; i + retention_ < snapshots.size(); i++)
+	{
+		fs::remove_all(snapshots[i]);
+	}
+	for (const fs::path& partial : list_folders(folder_, partial_prefix))
+	{
+		fs::remove_all(partial);
+	}
+}
+
+/// <summary>
+/// Copy the files of the newest snapshot into the database folder.
+/// must be called before the database is opened, the write-ahead log of the
+/// replaced database is removed so that it is not applied to the snapshot.
+/// </summary>
+/// <param name="folder">the folder holding the snapshots</param>
+/// <param name="database_folder">the folder of the database</param>
+/// <returns>false if there is no snapshot</returns>
+bool SnapshotScheduler::restore_latest(const std::string& folder, const std::string& database_folder)
+{
+	std::vector<fs::path> snapshots = list_folders(folder, snapshot_prefix);
+	if (snapshots.empty())
+	{
+		return false;
+	}
+	for (const auto& entry : fs::directory_iterator(snapshots.back()))
+	{
+		fs::path target = fs::path(database_folder) / entry.path().filename();
+		fs::remove(target.string() + "-wal");
+		fs::remove(target.string() + "-shm");
+		fs::copy_file(entry.path(), target, fs::copy_options::overwrite_existing);
+	}
+	CROW_LOG_WARNING << "Database restored from " << snapshots.back().string();
+	return true;
+}
\ No newline at end of file
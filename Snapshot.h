@@ -0,0 +1,60 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "DataBase.h"
+
+/// <summary>
+/// SnapshotScheduler takes online backups of the database in the background.
+/// A snapshot is a folder named snapshot-YYYYMMDD-HHMMSS-mmm holding a copy of the
+/// database, taken every interval or on request, only the newest ones are kept.
+/// </summary>
+class SnapshotScheduler
+{
+public:
+	struct Status
+	{
+		bool			running;
+		uint64_t		snapshots;		// snapshots taken since the start
+		std::string		last_snapshot;	// folder of the last snapshot
+		std::string		last_error;
+		std::chrono::milliseconds last_duration;
+		BackupPacing	pacing;			// pacing and measures of the last snapshot
+	};
+
+	SnapshotScheduler(DBSQLite& db, const std::string& folder, std::chrono::seconds interval, size_t retention);
+	~SnapshotScheduler();
+
+	bool request_snapshot();
+	Status get_status();
+
+	static bool restore_latest(const std::string& folder, const std::string& database_folder);
+
+private:
+	SnapshotScheduler(const SnapshotScheduler&) = delete;
+	SnapshotScheduler& operator=(const SnapshotScheduler&) = delete;
+
+	void run();
+	void take_snapshot();
+	void rotate();
+
+	DBSQLite&					db_;
+	std::string					folder_;
+	std::chrono::seconds		interval_;
+	size_t						retention_;
+
+	std::mutex					mutex_;
+	std::condition_variable		wakeup_;
+	bool						requested_ = false;
+	bool						stopping_ = false;
+	Status						status_{};
+	BackupPacing				pacing_;
+
+	std::thread					thread_;	// last member, started once the others are ready
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,230 @@
+// serialization_bench.cpp : times the listing of GET /meals on many threads at once, from
+// the rows read by SQLite to the body of the response, and counts the heap allocations.
+//   wvalue        : the former path, a std::list<DBMeal> turned into crow::json::wvalue objects
+//   reserved      : the rows on the heap, the body built in a reserved std::string
+//   arena body    : the rows on the heap, the body built in the request arena then copied
+//   arena         : the rows and the body in the request arena, the body copied (GET /meals)
+// The three last paths must produce the same body.
+//
+// usage: serialization_bench [threads] [rows] [requests per thread]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <crow.h>
+#include "Arena.h"
+#include "DBMeal.h"
+#include "MealJson.h"
+
+// Default shape of the run
+static const size_t default_threads = 32;
+static const size_t default_rows = 200;
+static const size_t default_requests = 2000;
+
+// Same estimate as Routes.cpp
+static const size_t meal_json_bytes = 80;
+
+// Heap allocations of the whole process, counted by the replaced operator new
+static std::atomic<uint64_t> heap_allocations{ 0 };
+
+void* operator new(size_t size)
+{
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+// the default memory resource of std::pmr allocates through the aligned form
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	size_t align = static_cast<size_t>(alignment);
+	if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// A row as returned by the query
+struct SourceRow
+{
+	std::string name;
+	int quantity;
+	int64_t price_cents;
+};
+
+static std::vector<SourceRow> make_rows(size_t count)
+{
+	std::vector<SourceRow> rows;
+	rows.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		rows.push_back(SourceRow{ "Meal \"" + std::to_string(i) + "\" of the day", static_cast<int>(i % 100), static_cast<int64_t>(500 + i * 7) });
+	}
+	return rows;
+}
+
+// Fill a set the way DBSQLite::read_meals does
+static DBMealSet read_set(const std::vector<SourceRow>& source, std::pmr::memory_resource* resource)
+{
+	DBMealSet meals(resource);
+	size_t name_bytes = 0;
+	for (const SourceRow& row : source)
+	{
+		name_bytes += row.name.size();
+	}
+	meals.reserve(source.size(), name_bytes);
+	for (size_t i = 0; i < source.size(); i++)
+	{
+		meals.add(static_cast<int64_t>(i), source[i].name.data(), source[i].name.size(), source[i].quantity, source[i].price_cents);
+	}
+	return meals;
+}
+
+template <class String>
+static void append_meals(String& body, const DBMealSet& meals)
+{
+	body += '[';
+	for (size_t i = 0; i < meals.size(); i++)
+	{
+		if (i != 0)
+		{
+			body += ',';
+		}
+		const DBMealSet::Row& row = meals[i];
+		append_meal_json(body, row.id, meals.get_name(row), row.quantity, row.has_price, row.price_cents);
+	}
+	body += ']';
+}
+
+static std::string wvalue_path(const std::vector<SourceRow>& source)
+{
+	std::list<DBMeal> meals;
+	for (const SourceRow& row : source)
+	{
+		meals.emplace_back(row.name, row.quantity, row.price_cents);
+	}
+	std::vector<crow::json::wvalue> members;
+	for (auto& meal : meals)
+	{
+		crow::json::wvalue meal_json;
+		meal_json["name"] = meal.get_name();
+		meal_json["quantity"] = meal.get_quantity();
+		meal_json["price"] = meal.get_price_cents() / 100.0;
+		members.push_back(meal_json);
+	}
+	crow::json::wvalue wv;
+	wv = std::move(members);
+	crow::response response(200, wv);
+	return std::move(response.body);
+}
+
+static std::string reserved_path(const std::vector<SourceRow>& source)
+{
+	DBMealSet meals = read_set(source, std::pmr::get_default_resource());
+	std::string body;
+	body.reserve(meals.size() * meal_json_bytes + 2);
+	append_meals(body, meals);
+	return body;
+}
+
+static std::string arena_body_path(const std::vector<SourceRow>& source)
+{
+	ArenaScope arena;
+	DBMealSet meals = read_set(source, std::pmr::get_default_resource());
+	std::pmr::string body(arena.resource());
+	body.reserve(meals.size() * meal_json_bytes + 2);
+	append_meals(body, meals);
+	return std::string(body);
+}
+
+static std::string arena_path(const std::vector<SourceRow>& source)
+{
+	ArenaScope arena;
+	DBMealSet meals = read_set(source, arena.resource());
+	std::pmr::string body(arena.resource());
+	body.reserve(meals.size() * meal_json_bytes + 2);
+	append_meals(body, meals);
+	return std::string(body);
+}
+
+/// <summary>
+/// Run a path on all the threads at once
+/// </summary>
+/// <returns>false if a thread built a body different from expected</returns>
+static bool run(const char* name, std::string (*path)(const std::vector<SourceRow>&), const std::vector<SourceRow>& source,
+	const std::string& expected, size_t threads, size_t requests)
+{
+	std::atomic<bool> same{ true };
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+
+	uint64_t allocations = heap_allocations.load();
+	auto start = std::chrono::steady_clock::now();
+	for (size_t t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&]()
+			{
+				for (size_t i = 0; i < requests; i++)
+				{
+					std::string body = path(source);
+					if (!expected.empty() && body != expected)
+					{
+						same = false;
+					}
+				}
+			});
+	}
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double total = static_cast<double>(threads * requests);
+	// the thread objects themselves account for a few allocations, negligible per request
+	std::printf("%-12s %10.0f requests/s %8.1f us/request %6.1f heap allocations/request\n", name, total / seconds,
+		seconds * 1e6 / total, (heap_allocations.load() - allocations) / total);
+	if (!same)
+	{
+		std::printf("FAILED: %s built a different body\n", name);
+	}
+	return same;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : default_threads;
+	size_t rows = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : default_rows;
+	size_t requests = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : default_requests;
+	std::printf("%zu threads, %zu rows per response, %zu requests per thread\n", threads, rows, requests);
+
+	std::vector<SourceRow> source = make_rows(rows);
+	std::string expected = reserved_path(source);
+
+	bool same = true;
+	same &= run("wvalue", wvalue_path, source, std::string(), threads, requests);
+	same &= run("reserved", reserved_path, source, expected, threads, requests);
+	same &= run("arena body", arena_body_path, source, expected, threads, requests);
+	same &= run("arena", arena_path, source, expected, threads, requests);
+
+	RequestArena::Statistics statistics = RequestArena::get_statistics();
+	std::printf("arenas: %llu threads, %llu allocations, %llu upstream allocations, peak %llu bytes per request\n",
+		static_cast<unsigned long long>(statistics.threads), static_cast<unsigned long long>(statistics.allocations),
+		static_cast<unsigned long long>(statistics.upstream_allocations), static_cast<unsigned long long>(statistics.peak_request_bytes));
+	return same ? 0 : 1;
+}
\ No newline at end of file
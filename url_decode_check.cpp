@@ -0,0 +1,162 @@
+// url_decode_check.cpp : compares Utility::url_decode with a plain reference decoder on
+// random inputs then times the decoding of a long name holding few escapes.
+// Built twice by CMake: with the SSE2 path and with UTILITY_NO_SSE2 for the portable one.
+//
+// usage: url_decode_check [inputs] [seed]
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include "utility.h"
+
+// Default number of random inputs compared
+static const size_t default_inputs = 300000;
+
+// Size of the name decoded by the benchmark, with one escape every escape_spacing bytes
+static const size_t benchmark_bytes = 1024 * 1024;
+static const size_t escape_spacing = 1000;
+
+/// <summary>
+/// Decode one byte at a time: "%XX" becomes the byte XX and "+" a space,
+/// a truncated escape, a non hexadecimal digit or "%00" is malformed
+/// </summary>
+/// <returns>false if the input is malformed</returns>
+static bool reference_decode(const std::string& in, std::string& out)
+{
+	out.clear();
+	for (size_t i = 0; i < in.size(); i++)
+	{
+		if (in[i] == '+')
+		{
+			out += ' ';
+		}
+		else if (in[i] == '%')
+		{
+			if (i + 2 >= in.size() || !std::isxdigit(static_cast<unsigned char>(in[i + 1])) || !std::isxdigit(static_cast<unsigned char>(in[i + 2])))
+			{
+				return false;
+			}
+			char value = static_cast<char>(std::stoi(in.substr(i + 1, 2), nullptr, 16));
+			if (value == 0)
+			{
+				return false;
+			}
+			out += value;
+			i += 2;
+		}
+		else
+		{
+			out += in[i];
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Random input biased towards the cases of the decoder: escapes, hexadecimal digits,
+/// '+', long plain runs crossing the 16 byte blocks and any other byte
+/// </summary>
+static std::string random_input(std::mt19937& random)
+{
+	static const char hex[] = "0123456789abcdefABCDEF";
+	std::uniform_int_distribution<int> length(0, 80);
+	std::uniform_int_distribution<int> kind(0, 9);
+	std::uniform_int_distribution<int> byte(0, 255);
+
+	std::string input;
+	size_t size = static_cast<size_t>(length(random));
+	while (input.size() < size)
+	{
+		switch (kind(random))
+		{
+		case 0:
+			input += '%';
+			input += hex[random() % (sizeof(hex) - 1)];
+			input += hex[random() % (sizeof(hex) - 1)];
+			break;
+		case 1: input += '%'; break;
+		case 2: input += '+'; break;
+		case 3: input += hex[random() % (sizeof(hex) - 1)]; break;
+		case 4: input += static_cast<char>(byte(random)); break;
+		case 5: input.append(static_cast<size_t>(random() % 40), 'a'); break;
+		default: input += static_cast<char>('a' + random() % 26); break;
+		}
+	}
+	return input;
+}
+
+// Bytes of a string in hexadecimal, to print a failing input
+static std::string hex_dump(const std::string& text)
+{
+	std::string dump;
+	char byte[4];
+	for (unsigned char c : text)
+	{
+		std::snprintf(byte, sizeof(byte), "%02x ", c);
+		dump += byte;
+	}
+	return dump;
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef UTILITY_URL_DECODE_SSE2
+	std::printf("url_decode with SSE2\n");
+#else
+	std::printf("url_decode portable\n");
+#endif
+	size_t inputs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : default_inputs;
+	std::mt19937 random(argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 12345u);
+
+	// compare with the reference, out of place and in place
+	std::string expected;
+	for (size_t i = 0; i < inputs; i++)
+	{
+		std::string input = random_input(random);
+		bool valid = reference_decode(input, expected);
+
+		std::string out(input.size(), '\0');
+		size_t length = 0;
+		bool decoded = Utility::url_decode(input, out.data(), length);
+		out.resize(decoded ? length : 0);
+
+		std::string in_place = input;
+		bool decoded_in_place = Utility::UnescapePostData(in_place);
+
+		if (decoded != valid || decoded_in_place != valid || (valid && (out != expected || in_place != expected)))
+		{
+			std::printf("FAILED on input %zu: %s\n", i, hex_dump(input).c_str());
+			std::printf("  expected %s: %s\n", valid ? "valid" : "malformed", hex_dump(expected).c_str());
+			std::printf("  decoded  %s: %s\n", decoded ? "valid" : "malformed", hex_dump(out).c_str());
+			return 1;
+		}
+	}
+	std::printf("%zu random inputs match the reference decoder\n", inputs);
+
+	// time a long name with few escapes, the case the SSE2 path is for
+	std::string name;
+	name.reserve(benchmark_bytes);
+	while (name.size() < benchmark_bytes)
+	{
+		name.append(escape_spacing, 'm');
+		name += "%20";
+	}
+	std::string out(name.size(), '\0');
+	size_t length = 0;
+	const int rounds = 200;
+	auto start = std::chrono::steady_clock::now();
+	for (int round = 0; round < rounds; round++)
+	{
+		if (!Utility::url_decode(name, out.data(), length))
+		{
+			std::printf("FAILED to decode the benchmark name\n");
+			return 1;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("%zu bytes decoded to %zu in %.1f us, %.2f GB/s\n", name.size(), length, seconds * 1e6 / rounds, name.size() * rounds / seconds / 1e9);
+	return 0;
+}
\ No newline at end of file
@@ -1,6 +1,21 @@
+#ifndef UTILITY_H
+#define UTILITY_H
+
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 
+// define UTILITY_NO_SSE2 to build the portable url_decode only
+#if !defined(UTILITY_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define UTILITY_URL_DECODE_SSE2
+#endif
+
 namespace fs = std::filesystem;
 
 namespace Utility
@@ -35,16 +50,216 @@ namespace Utility
 			fs::remove(get_temporary_folder(filename_db));
 		}
 	}
-	static void UnescapePostData(std::string& data) {
-		size_t pos;
-		while ((pos = data.find("+")) != std::string::npos) {
-			data.replace(pos, 1, " ");
+	// 64-bit FNV-1a hash, the same on every compiler and platform
+	static uint64_t fnv1a(std::string_view data)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : data)
+		{
+			hash = (hash ^ c) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Parse a decimal price ("12", "12.5", "12.45") into integer minor units (cents)
+	// reject signs, exponents, more than two decimals and values that do not fit
+	static bool parse_price(std::string_view text, int64_t& cents)
+	{
+		const int64_t max_units = INT64_MAX / 100;
+		int64_t units = 0;
+		size_t pos = 0;
+
+		while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9')
+		{
+			if (units > (max_units - (text[pos] - '0')) / 10)
+			{
+				return false;
+			}
+			units = units * 10 + (text[pos] - '0');
+			pos++;
+		}
+		if (pos == 0)
+		{
+			return false;
+		}
+
+		int64_t fraction = 0;
+		if (pos < text.size() && text[pos] == '.')
+		{
+			pos++;
+			size_t digits = 0;
+			while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9' && digits < 2)
+			{
+				fraction = fraction * 10 + (text[pos] - '0');
+				digits++;
+				pos++;
+			}
+			if (digits == 0)
+			{
+				return false;
+			}
+			if (digits == 1)
+			{
+				fraction *= 10;
+			}
+		}
+		if (pos != text.size())
+		{
+			return false;
+		}
+		// units * 100 fits, the fraction may still push the total past INT64_MAX
+		if (units == max_units && fraction > INT64_MAX % 100)
+		{
+			return false;
+		}
+
+		cents = units * 100 + fraction;
+		return true;
+	}
+
+	// Format a price in cents as a decimal string with two decimals ("12.45")
+	// buffer must hold at least 24 characters, returns the number of characters written
+	static size_t format_price(int64_t cents, char* buffer)
+	{
+		char digits[24];
+		size_t count = 0;
+		bool negative = cents < 0;
+		uint64_t value = negative ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+
+		// write the digits backwards, at least three so that "0.05" keeps its leading zero
+		do
+		{
+			digits[count++] = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value != 0 || count < 3);
+
+		size_t length = 0;
+		if (negative)
+		{
+			buffer[length++] = '-';
+		}
+		while (count > 2)
+		{
+			buffer[length++] = digits[--count];
+		}
+		buffer[length++] = '.';
+		buffer[length++] = digits[1];
+		buffer[length++] = digits[0];
+		return length;
+	}
+
+	static std::string format_price(int64_t cents)
+	{
+		char buffer[24];
+		return std::string(buffer, format_price(cents, buffer));
+	}
+
+	// Value of an hexadecimal digit, -1 if the character is not one
+	static int hex_digit(unsigned char c)
+	{
+		if (static_cast<unsigned>(c - '0') < 10u)
+		{
+			return c - '0';
+		}
+		c |= 0x20;
+		if (static_cast<unsigned>(c - 'a') < 6u)
+		{
+			return c - 'a' + 10;
 		}
-		while ((pos = data.find("%")) != std::string::npos) {
-			if (pos <= data.length() - 3) {
-				char replace[2] = { (char)(std::stoi("0x" + data.substr(pos + 1,2), NULL, 16)), '\0' };
-				data.replace(pos, 3, replace);
+		return -1;
+	}
+
+#ifdef UTILITY_URL_DECODE_SSE2
+	// Index of the lowest bit set, mask must not be 0
+	static unsigned lowest_bit(unsigned mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<unsigned>(index);
+#else
+		return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+	}
+#endif
+
+	// Decode a percent-encoded string in a single pass: "%XX" becomes the byte XX and "+" a space.
+	// out needs in.size() bytes and may be in.data() itself since the output is never longer
+	// than the input. Returns false on a malformed escape ("%", "%4", "%zz") or an encoded NUL.
+	// With SSE2 the runs of 16 bytes holding neither '%' nor '+' are copied at once.
+	static bool url_decode(std::string_view in, char* out, size_t& length)
+	{
+		const char* p = in.data();
+		const size_t n = in.size();
+		size_t i = 0;
+		size_t o = 0;
+
+		while (i < n)
+		{
+#ifdef UTILITY_URL_DECODE_SSE2
+			const __m128i percent = _mm_set1_epi8('%');
+			const __m128i plus = _mm_set1_epi8('+');
+			while (i + 16 <= n)
+			{
+				__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+				unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, percent), _mm_cmpeq_epi8(chunk, plus))));
+				if (mask != 0)
+				{
+					// copy the bytes before the first '%' or '+'
+					unsigned skip = lowest_bit(mask);
+					std::memmove(out + o, p + i, skip);
+					i += skip;
+					o += skip;
+					break;
+				}
+				// o <= i: in place, the store only overwrites bytes already loaded
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), chunk);
+				i += 16;
+				o += 16;
+			}
+			if (i == n)
+			{
+				break;
+			}
+#endif
+			char c = p[i];
+			if (c == '%')
+			{
+				if (n - i < 3)
+				{
+					return false;
+				}
+				int high = hex_digit(static_cast<unsigned char>(p[i + 1]));
+				int low = hex_digit(static_cast<unsigned char>(p[i + 2]));
+				if ((high | low) < 0 || (high | low) == 0)
+				{
+					return false;
+				}
+				out[o++] = static_cast<char>((high << 4) | low);
+				i += 3;
+			}
+			else
+			{
+				out[o++] = c == '+' ? ' ' : c;
+				i++;
 			}
 		}
+
+		length = o;
+		return true;
 	}
-}
\ No newline at end of file
+
+	// Decode a percent-encoded string in place, false if it holds a malformed escape
+	static bool UnescapePostData(std::string& data)
+	{
+		size_t length = 0;
+		if (!url_decode(data, data.data(), length))
+		{
+			return false;
+		}
+		data.resize(length);
+		return true;
+	}
+}
+
+#endif
\ No newline at end of file